@@ -0,0 +1,39 @@
+// Convert a graph file to the binary format of mygraphlib, that is read
+// by ReadListGraph and ReadListGraph3 with a single mmap.
+#include <iostream>
+#include <lemon/list_graph.h>
+#include "mygraphlib.h"
+#include "myutils.h"
+using namespace lemon;
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+  bool nodeweights = (argc==4 && string(argv[3])=="-nodeweights");
+  if (argc!=3 && !nodeweights) {
+    cout<<"Usage: "<< argv[0]<<" <graph_filename> <binary_filename> [-nodeweights]"<<endl<<
+      "       -nodeweights: the graph has node weights, values and a capacity, as read by ReadListGraph3"<<endl<<
+      "Example: "<< argv[0]<<" gr_att532 gr_att532.bin"<<endl<<
+      "         "<< argv[0]<<" inputs/gr_100v inputs/gr_100v.bin -nodeweights"<<endl;
+    exit(0);}
+  if (!FileExists(argv[1])) {cout<<"File "<<argv[1]<<" does not exist."<<endl; exit(0);}
+
+  ListGraph g;
+  NodeStringMap vname(g);
+  EdgeValueMap weight(g);
+  NodePosMap posx(g),posy(g);
+  NodeIntMap nodeweight(g),nodevalue(g);
+  int C;
+  bool ok;
+  if (nodeweights) {
+    ok = ReadListGraph3(argv[1],g,vname,nodeweight,nodevalue,posx,posy,C);
+    for (EdgeIt e(g); e!=INVALID; ++e) weight[e] = 0.0;
+    ok = ok && WriteListGraphBinary(argv[2],g,vname,weight,posx,posy,nodeweight,nodevalue,C);
+  } else {
+    ok = ReadListGraph(argv[1],g,vname,weight,posx,posy);
+    ok = ok && WriteListGraphBinary(argv[2],g,vname,weight,posx,posy);
+  }
+  if (!ok) {cout<<"Error converting "<<argv[1]<<"."<<endl; exit(1);}
+  cout<<"Wrote "<<argv[2]<<" with "<<countNodes(g)<<" nodes and "<<countEdges(g)<<" edges."<<endl;
+  return(0);
+}
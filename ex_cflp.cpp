@@ -2,8 +2,12 @@
 // Flvio Keidi Miyazawa
 // Problems with connectivity: Capacitated Facility Location
 #include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <string>
 #include <queue>
+#include <algorithm>
+#include <float.h>
 #include "mygraphlib.h"
 #include "myutils.h"
 #include <lemon/lp.h>
@@ -13,17 +17,54 @@
 using namespace lemon;
 using namespace std;
 
-#if __cplusplus >= 201103L
-#include <unordered_map>
-#else
-#include <tr1/unordered_map>
-#endif
-
-
 enum node_type_t { FACILITY, CLIENT };
 
-void PulaBrancoComentario(ifstream &ifile);
-
+// Read an instance in the binary CFLP format (see mygraphlib.h), as written
+// by generate_cflp_instance with -binary. The records are read in blocks.
+bool ReadCFLPBinaryInstance(string filename, ListDigraph &g,
+                      DNodeStringMap & vname,
+                      ArcValueMap    & edge_weight,
+                      DNodeValueMap  & facility_weight,
+                      DNodeIntMap    & facility_capacity,
+                      DNodePosMap  & posx,
+                      DNodePosMap  & posy)
+{
+  const size_t BLOCK=1<<16;
+  CFLPBinaryHeader h;
+  FILE *in = fopen(filename.c_str(),"rb");
+  if (in==NULL) {cout << "File '" << filename << "' does not exist.\n"; exit(0);}
+  if (fread(&h,sizeof(h),1,in)!=1 || memcmp(h.magic,CFLP_BINARY_MAGIC,8)!=0)
+    {cout<<"File "<<filename<<" is not a binary CFLP instance.\n"; exit(0);}
+  size_t n=(size_t) h.nclients+h.nfacilities,i=0;
+  vector<DNode> V(n);
+  g.reserveNode((int) n);  g.reserveArc((int) h.narcs);
+  vector<CFLPBinaryNode> node(BLOCK);
+  while (i<n) {
+    size_t r=min(BLOCK,n-i);
+    if (fread(&node[0],sizeof(CFLPBinaryNode),r,in)!=r)
+      {cout<<"Reached unexpected end of file "<<filename<<".\n";exit(0);}
+    for (size_t b=0;b<r;b++,i++) {
+      DNode v = g.addNode();  V[i] = v;
+      vname[v] = (i<h.nclients) ? "c"+IntToString((int) i+1) : "f"+IntToString((int) (i-h.nclients)+1);
+      posx[v] = node[b].x;  posy[v] = node[b].y;
+      facility_weight[v] = node[b].weight;  facility_capacity[v] = (int) node[b].capacity;
+    }
+  }
+  vector<CFLPBinaryArc> arc(BLOCK);
+  for (uint64_t e=0;e<h.narcs;) {
+    size_t r=(size_t) min((uint64_t) BLOCK,h.narcs-e);
+    if (fread(&arc[0],sizeof(CFLPBinaryArc),r,in)!=r)
+      {cout<<"Reached unexpected end of file "<<filename<<".\n";exit(0);}
+    for (size_t b=0;b<r;b++,e++) {
+      if (arc[b].client>=h.nclients || arc[b].facility>=h.nfacilities)
+	{cout<<"ERROR: Unknown node in arc "<<e+1<<" of file "<<filename<<".\n";exit(0);}
+      Arc a = g.addArc(V[arc[b].client],V[h.nclients+arc[b].facility]);
+      edge_weight[a] = arc[b].weight;
+    }
+  }
+  fclose(in);
+  return(true);
+}
 
 // Read an instance for the Capacitated Facility Location Problem
 bool ReadCFLPInstance(string filename, ListDigraph &g,
@@ -34,88 +75,405 @@ bool ReadCFLPInstance(string filename, ListDigraph &g,
                       DNodePosMap  & posx,
                       DNodePosMap  & posy)
 {
+  GraphFileTokenizer in;
   int i,n,m;
   double peso;
   Arc a;
-  string nomeu,nomev;
-
-#if __cplusplus >= 201103L
-  std::unordered_map<string,DNode> nodemap;
-#else
-  std::tr1::unordered_map<string,DNode> nodemap;
-#endif
-
+  const char *nomeu,*endnomeu,*nomev,*endnomev;
+  DNode v;
 
-  
-  ifstream ifile;
-  ifile.open(filename.c_str());
-  if (!ifile) {cout << "File '" << filename << "' does not exist.\n"; exit(0);}
-  PulaBrancoComentario(ifile);
-  ifile >> n;    ifile >> m; // first line have number of nodes and number of arcs
-  if (m<0||ifile.eof()){cout<<"File "<<filename<<" is not a graph given by arcs.\n";
-    exit(0);}
-  string STR;
-  DNode u,v;
+  char magic[8];
+  ifstream bin(filename.c_str(),ios::binary);
+  if (bin.read(magic,8) && memcmp(magic,CFLP_BINARY_MAGIC,8)==0)
+    return(ReadCFLPBinaryInstance(filename,g,vname,edge_weight,facility_weight,
+				  facility_capacity,posx,posy));
+  bin.close();
+  if (!in.Open(filename)) {cout << "File '" << filename << "' does not exist.\n"; exit(0);}
+  in.SkipComments();
+  // first line have number of nodes and number of arcs
+  if (!in.ReadInt(n) || !in.ReadInt(m) || n<0 || m<0)
+    {cout<<"File "<<filename<<" is not a graph given by arcs.\n"; exit(0);}
+  vector<DNode> V(n);
+  in.ReserveNames(n);
+  g.reserveNode(n);  g.reserveArc(m);
   for (i=0;i<n;i++) {
-    getline(ifile,STR);
-    if (ifile.eof()) {cout<<"Reached unexpected end of file "<<filename<<".\n";exit(0);}
-    while (STR=="") getline(ifile,STR);
-    {
-      string token;
-      istringstream ins; // Declare an input string stream.
-      ins.str(STR);        // Specify string to read.
-      int nt = 0;
-      while( getline(ins, token, ' ') ) {
-	// format: <node_name>  <pos_x>  <pos_y>  <facility_weight>  <facility_capacity>
-	if (nt==0) {
-	  auto test = nodemap.find(token);
-	  if (test!=nodemap.end()){cout<<"ERROR: Repeated node: "<<nomev<<endl;exit(0);}
-	  v = g.addNode();
-	  nodemap[token] = v;
-	  vname[v] = token;}
-	else if (nt==1) { posx[v] = atof(token.c_str());}
-	else if (nt==2) { posy[v] = atof(token.c_str());}
-	else if (nt==3) { facility_weight[v] = atof(token.c_str());}
-	else if (nt==4) { facility_capacity[v] = atoi(token.c_str());}
-	nt++;
-      }
-    }
+    // format: <node_name>  <pos_x>  <pos_y>  <facility_weight>  <facility_capacity>
+    if (!in.NextLine() || !in.NextTokenInLine(nomev,endnomev))
+      {cout<<"Reached unexpected end of file "<<filename<<".\n";exit(0);}
+    if (!in.AddName(nomev,endnomev,i))
+      {cout<<"ERROR: Repeated node: "<<string(nomev,endnomev)<<endl;exit(0);}
+    v = g.addNode();  V[i] = v;  vname[v] = string(nomev,endnomev);
+    if ((in.NextTokenInLine(nomev,endnomev) && !GraphFileTokenizer::ParseDouble(nomev,endnomev,posx[v])) ||
+	(in.NextTokenInLine(nomev,endnomev) && !GraphFileTokenizer::ParseDouble(nomev,endnomev,posy[v])) ||
+	(in.NextTokenInLine(nomev,endnomev) && !GraphFileTokenizer::ParseDouble(nomev,endnomev,facility_weight[v])) ||
+	(in.NextTokenInLine(nomev,endnomev) && !GraphFileTokenizer::ParseInt(nomev,endnomev,facility_capacity[v])))
+      {cout<<"File "<<filename<<" is not a graph given by arcs.\n"; exit(0);}
   }
+  in.NextLine(); // what is left in the last node line is not an arc
   for (i=0;i<m;i++) {
     // format: <cliente_node>   <facility_node>   <arc_weight>
-    ifile >> nomeu;  ifile >> nomev; ifile >> peso;
-    if (ifile.eof()) 
+    if (!in.NextToken(nomeu,endnomeu) || !in.NextToken(nomev,endnomev) || !in.ReadDouble(peso))
       {cout << "Reached unexpected end of file " <<filename << ".\n"; exit(0);}
-    auto test = nodemap.find(nomeu);
-    if (test == nodemap.end()) {cout<<"ERROR: Unknown node: "<<nomeu<<endl;exit(0);}
-    else u = nodemap[nomeu];
-    
-    test = nodemap.find(nomev);
-    if (test == nodemap.end()) {cout<<"ERROR: Unknown node: "<<nomev<<endl;exit(0);}
-    else v = nodemap[nomev];
-    
-    a = g.addArc(u,v);     edge_weight[a] = peso;
+    int u = in.FindName(nomeu,endnomeu);
+    if (u<0) {cout<<"ERROR: Unknown node: "<<string(nomeu,endnomeu)<<endl;exit(0);}
+    int w = in.FindName(nomev,endnomev);
+    if (w<0) {cout<<"ERROR: Unknown node: "<<string(nomev,endnomev)<<endl;exit(0);}
+    a = g.addArc(V[u],V[w]);     edge_weight[a] = peso;
+  }
+  return(true);
+}
+
+
+// parameters of the Lagrangian relaxation
+#define LAGRANGIAN_MAXIT 500   // maximum number of iterations of the subgradient method
+#define LAGRANGIAN_HEURFREQ 10 // the primal heuristic is run at each LAGRANGIAN_HEURFREQ iterations
+
+// Lagrangian relaxation of the CFLP, relaxing the constraints that connect
+// each client i (sum_j x_ij >= 1) with multipliers lambda_i >= 0. The
+// relaxation splits in one knapsack for each facility j (with unit weights):
+// connect the (at most cap_j) clients of most negative c_ij - lambda_i, with
+// value v_j = f_j + the sum of these c_ij - lambda_i. So
+//    L0(lambda) = sum_i lambda_i + sum_j min(0,v_j)
+// is a lower bound. The bound L(lambda) >= L0(lambda), maximized by the
+// subgradient method, also keeps the valid constraint sum_j cap_j y_j >= |C|,
+// by its linear relaxation: after the facilities with v_j < 0, the ones of
+// smallest v_j/cap_j are opened (the last one fractionally) until the
+// capacity is enough for all clients. The facilities opened by the
+// relaxation are repaired to a solution (upper bound) by Repair. And, with
+// the best multipliers, a facility j with L0 + v_j >= UpperBound is closed
+// in any better solution, as well as a facility with L0 - v_j >= UpperBound
+// is open.
+class CFLP_Lagrangian {
+public:
+  CFLP_Lagrangian(Digraph &g,DNodeStringMap &vname,ArcValueMap &edge_weight,
+		  DNodeValueMap &facility_weight,DNodeIntMap &facility_capacity,
+		  Digraph::NodeMap<node_type_t> &vtype);
+  void Run(int maxit); // subgradient method, with the primal heuristic
+  double LowerBound,UpperBound;
+  int nC,nF;
+  vector<DNode> Client,Facility;
+  vector<Arc> BestArc;   // arc of each client in the best solution found
+  vector<char> BestOpen; // facilities open in the best solution found
+  vector<int> Fixed;     // -1 (closed) or 1 (open) in any better solution, 0 otherwise
+private:
+  DNodeStringMap &vname;
+  struct Link { int i; double c; Arc a; }; // connection to client/facility i, of cost c
+  vector<vector<Link> > FacLinks,CliLinks; // links of each facility and of each client
+  vector<double> F;      // opening cost of each facility
+  vector<int> Cap;       // capacity of each facility
+  vector<double> Lambda,V,BestV,Ratio;
+  vector<double> Y;      // fraction of each facility opened in the relaxation
+  vector<double> Cover;  // sum of Y of the facilities that connect each client in the relaxation
+  vector<int> ByRatio;   // facilities by increasing v_j/cap_j
+  vector<pair<double,int> > Sel; // (c_ij - lambda_i, i) for a facility
+  vector<vector<int> > SelClients; // clients connected to each facility in the relaxation
+  double Relaxation(double &L0); // L(lambda) and L0(lambda), setting V, Y and Cover
+  bool Repair(const vector<double> &Order); // open facilities in this order (smallest first)
+};
+
+CFLP_Lagrangian::CFLP_Lagrangian(Digraph &g,DNodeStringMap &vname,ArcValueMap &edge_weight,
+				 DNodeValueMap &facility_weight,DNodeIntMap &facility_capacity,
+				 Digraph::NodeMap<node_type_t> &vtype) : vname(vname)
+{
+  DNodeIntMap Index(g);
+  for (DNodeIt v(g); v!=INVALID; ++v) {
+    if (vtype[v]==CLIENT) {Index[v] = (int) Client.size();  Client.push_back(v);}
+    else {
+      Index[v] = (int) Facility.size();  Facility.push_back(v);
+      F.push_back(facility_weight[v]);  Cap.push_back(facility_capacity[v]);
+    }
+  }
+  nC = (int) Client.size();  nF = (int) Facility.size();
+  FacLinks.resize(nF);  CliLinks.resize(nC);
+  for (ArcIt a(g); a!=INVALID; ++a) {
+    int i=Index[g.source(a)],j=Index[g.target(a)];
+    Link l;
+    l.c = edge_weight[a];  l.a = a;
+    l.i = i;  FacLinks[j].push_back(l);
+    l.i = j;  CliLinks[i].push_back(l);
+  }
+  Lambda.resize(nC);  V.resize(nF);  Ratio.resize(nF);  Y.resize(nF);  Cover.resize(nC);
+  SelClients.resize(nF);  ByRatio.resize(nF);
+  Fixed.assign(nF,0);
+  LowerBound = -DBL_MAX;  UpperBound = DBL_MAX;
+}
+
+double CFLP_Lagrangian::Relaxation(double &L0)
+{
+  double L=0.0,capacity=0.0;
+  for (int i=0;i<nC;i++) {L += Lambda[i];  Cover[i] = 0.0;}
+  for (int j=0;j<nF;j++) {
+    Sel.clear();
+    for (unsigned l=0;l<FacLinks[j].size();l++) {
+      double r=FacLinks[j][l].c-Lambda[FacLinks[j][l].i];
+      if (r < 0) Sel.push_back(make_pair(r,FacLinks[j][l].i));
+    }
+    if ((int) Sel.size() > Cap[j]) {
+      nth_element(Sel.begin(),Sel.begin()+Cap[j],Sel.end());
+      Sel.resize(Cap[j]);
+    }
+    V[j] = F[j];
+    SelClients[j].clear();
+    for (unsigned k=0;k<Sel.size();k++) {V[j] += Sel[k].first;  SelClients[j].push_back(Sel[k].second);}
+    Ratio[j] = (Cap[j] > 0) ? V[j]/Cap[j] : DBL_MAX; // no capacity: last
+    ByRatio[j] = j;
+  }
+  sort(ByRatio.begin(),ByRatio.end(),[this](int a,int b) {return(Ratio[a]<Ratio[b]);});
+  L0 = L;
+  for (int k=0;k<nF;k++) {
+    int j=ByRatio[k];
+    if (V[j] < 0) {Y[j] = 1.0;  L0 += V[j];}
+    else if ((capacity < nC) && (Cap[j] > 0)) Y[j] = min(1.0,(nC-capacity)/Cap[j]);
+    else Y[j] = 0.0; // a facility without capacity does not help the cover
+    capacity += Y[j]*Cap[j];
+    L += Y[j]*V[j];
+    for (unsigned l=0;l<SelClients[j].size();l++) Cover[SelClients[j][l]] += Y[j];
   }
-  ifile.close();
+  return(L);
+}
+
+// Open the facilities with Order[j] < 0, and then the other ones by
+// increasing Order[j] until their capacity is enough for all clients. The
+// clients are connected by decreasing regret (difference between the two
+// cheapest open facilities), each one to the cheapest open facility with
+// free capacity (if there is none, a closed facility is opened). Then,
+// each client moves to a cheaper facility with free capacity, and
+// facilities without clients are closed (unless they are fixed open).
+bool CFLP_Lagrangian::Repair(const vector<double> &Order)
+{
+  vector<char> Open(nF,0);
+  vector<int> Load(nF,0),Conn(nC,-1),ByOrder(nF); // Conn[i]: link of client i
+  vector<pair<double,int> > Regret(nC);
+  long long capacity=0;
+  for (int j=0;j<nF;j++) ByOrder[j]=j;
+  sort(ByOrder.begin(),ByOrder.end(),[&Order](int a,int b) {return(Order[a]<Order[b]);});
+  for (int k=0;k<nF;k++) {
+    int j=ByOrder[k];
+    if ((Order[j] >= 0) && (capacity >= nC)) break;
+    if (Fixed[j] < 0) continue;
+    Open[j] = 1;  capacity += Cap[j];
+  }
+  for (int j=0;j<nF;j++) if (Fixed[j] > 0) Open[j] = 1;
+  for (int i=0;i<nC;i++) {
+    double c1=DBL_MAX,c2=DBL_MAX;
+    for (unsigned l=0;l<CliLinks[i].size();l++) {
+      if (!Open[CliLinks[i][l].i]) continue;
+      double c=CliLinks[i][l].c;
+      if (c < c1) {c2 = c1;  c1 = c;} else if (c < c2) c2 = c;
+    }
+    Regret[i] = make_pair((c2==DBL_MAX) ? -DBL_MAX : c1-c2,i); // most negative first
+  }
+  sort(Regret.begin(),Regret.end());
+  double cost=0.0;
+  for (int k=0;k<nC;k++) {
+    int i=Regret[k].second,best=-1;
+    for (unsigned l=0;l<CliLinks[i].size();l++) {
+      int j=CliLinks[i][l].i;
+      if (Open[j] && (Load[j] < Cap[j]) && ((best<0) || (CliLinks[i][l].c < CliLinks[i][best].c))) best = l;
+    }
+    if (best < 0) { // open the closed facility of smallest f_j + c_ij
+      for (unsigned l=0;l<CliLinks[i].size();l++) {
+	int j=CliLinks[i][l].i;
+	if (!Open[j] && (Fixed[j] >= 0) && (Cap[j] > 0) &&
+	    ((best<0) || (F[j]+CliLinks[i][l].c < F[CliLinks[i][best].i]+CliLinks[i][best].c))) best = l;
+      }
+      if (best < 0) return(false);
+      Open[CliLinks[i][best].i] = 1;
+    }
+    Conn[i] = best;  Load[CliLinks[i][best].i]++;
+  }
+  for (int i=0;i<nC;i++) {
+    Link &cur=CliLinks[i][Conn[i]];
+    int best=Conn[i];
+    for (unsigned l=0;l<CliLinks[i].size();l++) {
+      int j=CliLinks[i][l].i;
+      if (Open[j] && (Load[j] < Cap[j]) && (CliLinks[i][l].c < CliLinks[i][best].c)) best = l;
+    }
+    if (best!=Conn[i]) {Load[cur.i]--;  Load[CliLinks[i][best].i]++;  Conn[i] = best;}
+  }
+  // close each facility (by increasing load) whose clients can move to other
+  // open facilities with free capacity for less than its opening cost
+  vector<vector<int> > Members(nF);
+  vector<int> Move;
+  for (int i=0;i<nC;i++) Members[CliLinks[i][Conn[i]].i].push_back(i);
+  sort(ByOrder.begin(),ByOrder.end(),[&Load](int a,int b) {return(Load[a]<Load[b]);});
+  for (int k=0;k<nF;k++) {
+    int j=ByOrder[k];
+    if ((Load[j]==0) || (Fixed[j] > 0)) continue;
+    double delta=0.0;
+    Move.clear();
+    for (unsigned m=0;(m<Members[j].size()) && (delta < F[j]);m++) {
+      int i=Members[j][m],best=-1;
+      for (unsigned l=0;l<CliLinks[i].size();l++) {
+	int h=CliLinks[i][l].i;
+	if ((h!=j) && Open[h] && (Load[h] < Cap[h]) && ((best<0) || (CliLinks[i][l].c < CliLinks[i][best].c))) best = l;
+      }
+      if (best < 0) {delta = F[j];  break;}
+      Move.push_back(best);  Load[CliLinks[i][best].i]++;
+      delta += CliLinks[i][best].c-CliLinks[i][Conn[i]].c;
+    }
+    if (delta < F[j]-MY_EPS) {
+      for (unsigned m=0;m<Move.size();m++) {
+	int i=Members[j][m];
+	Conn[i] = Move[m];  Members[CliLinks[i][Move[m]].i].push_back(i);
+      }
+      Members[j].clear();  Load[j] = 0;  Open[j] = 0;
+    } else for (unsigned m=0;m<Move.size();m++) Load[CliLinks[Members[j][m]][Move[m]].i]--;
+  }
+  for (int i=0;i<nC;i++) cost += CliLinks[i][Conn[i]].c;
+  for (int j=0;j<nF;j++) {
+    Open[j] = (Open[j] && (Load[j] > 0)) || (Fixed[j] > 0);
+    if (Open[j]) cost += F[j];
+  }
+  if (cost >= UpperBound-MY_EPS) return(false);
+  UpperBound = cost;
+  BestOpen = Open;
+  BestArc.resize(nC);
+  for (int i=0;i<nC;i++) BestArc[i] = CliLinks[i][Conn[i]].a;
   return(true);
 }
 
+void CFLP_Lagrangian::Run(int maxit)
+{
+  double theta=2.0,L,L0,BestL0=-DBL_MAX,norm,target;
+  vector<double> Order(nF);
+  int noimprove=0;
+  // start with lambda_i as the cheapest connection of i, and open the
+  // facilities by their cost per unit of capacity
+  for (int i=0;i<nC;i++) {
+    Lambda[i] = DBL_MAX;
+    for (unsigned l=0;l<CliLinks[i].size();l++) Lambda[i] = min(Lambda[i],CliLinks[i][l].c);
+    if (Lambda[i]==DBL_MAX) {cout << "Client " << vname[Client[i]] << " can not be connected" << endl; return;}
+  }
+  for (int j=0;j<nF;j++) Ratio[j] = F[j]/max(1,Cap[j]);
+  Repair(Ratio);
+  for (int it=0;it<maxit;it++) {
+    L = Relaxation(L0);
+    if (L > LowerBound+MY_EPS) {LowerBound = L;  BestL0 = L0;  BestV = V;  noimprove = 0;}
+    else if (++noimprove >= 20) {theta /= 2;  noimprove = 0;}
+    if ((it % LAGRANGIAN_HEURFREQ)==0) {
+      for (int j=0;j<nF;j++) Order[j] = (Y[j] > 0) ? -Y[j] : Ratio[j];
+      Repair(Order); // open first the facilities opened by the relaxation
+    }
+    if ((UpperBound-LowerBound < MY_EPS*max(1.0,fabs(UpperBound))) || (theta < 1e-4)) break;
+    norm = 0.0;
+    for (int i=0;i<nC;i++) norm += (1-Cover[i])*(1-Cover[i]);
+    if (norm==0) break; // each client is connected once, so there is no gap
+    target = (UpperBound < DBL_MAX) ? UpperBound : L+max(1.0,0.1*fabs(L));
+    for (int i=0;i<nC;i++) Lambda[i] = max(0.0,Lambda[i]+theta*(target-L)/norm*(1-Cover[i]));
+  }
+  printf("[Lagrangian] lower bound %.4f, upper bound %.4f\n",LowerBound,UpperBound);
+  if ((UpperBound == DBL_MAX) || BestV.empty()) return;
+  int nclosed=0,nopen=0;
+  for (int j=0;j<nF;j++) {
+    if ((BestV[j] > 0) && (BestL0+BestV[j] >= UpperBound-MY_EPS)) {Fixed[j] = -1; nclosed++;}
+    else if ((BestV[j] < 0) && (BestL0-BestV[j] >= UpperBound-MY_EPS)) {Fixed[j] = 1; nopen++;}
+  }
+  printf("[Lagrangian] %d facilities fixed closed and %d fixed open\n",nclosed,nopen);
+}
+
+
+// Cuts for the aggregated formulation, where each facility j has only the
+// row sum_i x_ij <= cap_j y_j. At each node with optimal relaxation, it adds
+// the disaggregated rows x_ij <= y_j that are violated (at most
+// CFLP_MAXCUTS, the most violated first) and the capacity cover
+//    sum_j min(cap_j,nC) y_j >= nC
+// if the relaxation violates it. The integer solutions of the aggregated
+// formulation are already feasible, so these are user cuts (addCut), only
+// to strengthen the relaxation, and there is nothing to do at MIPSOL.
+#define CFLP_MAXCUTS 200   // maximum number of disaggregated rows added per node
+#define CFLP_CUTEPS 1e-4   // minimum violation of an added cut
 
+class CFLP_LinkingCuts: public GRBCallback
+{
+  vector<GRBVar> xvars,yvars;
+  vector<int> Fac;        // Fac[k] is the index in yvars of the facility of arc k
+  vector<char> Added;     // the row x_k <= y_Fac[k] was already added
+  vector<double> CoverCoef;
+  int nC;
+  bool CoverAdded;
+  vector<pair<double,int> > Violated;
+public:
+  int NLinking,NCover;    // number of cuts added
+  CFLP_LinkingCuts(Digraph &g, Digraph::ArcMap<GRBVar> &x, Digraph::NodeMap<GRBVar> &y,
+		   DNodeIntMap &facility_capacity, Digraph::NodeMap<node_type_t> &vtype) :
+    nC(0),CoverAdded(false),NLinking(0),NCover(0)
+  {
+    DNodeIntMap index(g,-1);
+    for (DNodeIt v(g); v!=INVALID; ++v) {
+      if (vtype[v]==CLIENT) {nC++; continue;}
+      index[v] = (int) yvars.size();  yvars.push_back(y[v]);
+    }
+    for (DNodeIt v(g); v!=INVALID; ++v)
+      if (vtype[v]==FACILITY) CoverCoef.push_back(min(facility_capacity[v],nC));
+    for (ArcIt e(g); e!=INVALID; ++e) {xvars.push_back(x[e]);  Fac.push_back(index[g.target(e)]);}
+    Added.assign(xvars.size(),0);
+  }
+protected:
+  void callback()
+  {
+    if ((where!=GRB_CB_MIPNODE) || (getIntInfo(GRB_CB_MIPNODE_STATUS)!=GRB_OPTIMAL)) return;
+    try {
+      int nx=(int) xvars.size(),ny=(int) yvars.size();
+      double *xval = getNodeRel(&xvars[0],nx);
+      double *yval = getNodeRel(&yvars[0],ny);
+      Violated.clear();
+      for (int k=0;k<nx;k++)
+	if (!Added[k] && xval[k] > yval[Fac[k]]+CFLP_CUTEPS)
+	  Violated.push_back(make_pair(yval[Fac[k]]-xval[k],k));
+      if ((int) Violated.size() > CFLP_MAXCUTS) {
+	nth_element(Violated.begin(),Violated.begin()+CFLP_MAXCUTS,Violated.end());
+	Violated.resize(CFLP_MAXCUTS);
+      }
+      for (unsigned i=0;i<Violated.size();i++) {
+	int k=Violated[i].second;
+	addCut( xvars[k] <= yvars[Fac[k]] );
+	Added[k] = 1;  NLinking++;
+      }
+      if (!CoverAdded) {
+	double lhs=0.0;
+	for (int j=0;j<ny;j++) lhs += CoverCoef[j]*yval[j];
+	if (lhs < nC-CFLP_CUTEPS) {
+	  GRBLinExpr expr;
+	  expr.addTerms(&CoverCoef[0],&yvars[0],ny);
+	  addCut( expr >= nC );
+	  CoverAdded = true;  NCover++;
+	}
+      }
+      delete[] xval;
+      delete[] yval;
+    } catch (GRBException e) {
+      cout << "Error number: " << e.getErrorCode() << endl;
+      cout << e.getMessage() << endl;
+    } catch (...) {
+      cout << "Error during callback**" << endl;
+    }
+  }
+};
 
 
 int main(int argc, char *argv[])
 {
   Digraph g;  // graph declaration
   string digraph_kpaths_filename;
+  // -aggregated: use the aggregated formulation and separate the disaggregated rows
+  bool aggregated = (argc>=3) && (string(argv[argc-1])=="-aggregated");
+  if (aggregated) argc--;
   if ((argc!=2) && (argc!=4)) {
     cout << endl << "Sintax to read instance from a file:" << endl ;
-    cout << "      " << argv[0] << " <filename>" << endl << endl;
+    cout << "      " << argv[0] << " <filename> [-aggregated]" << endl;
+    cout << "      (text or binary instance, see generate_cflp_instance)" << endl << endl;
     
     cout << "Sintax to generate random instance:" << endl;
-    cout << "      " << argv[0] << " <number_of_clients>  <number_of_facilities>  <capacity>" << endl << endl;
+    cout << "      " << argv[0] << " <number_of_clients>  <number_of_facilities>  <capacity> [-aggregated]" << endl << endl;
+    cout << "  -aggregated: use only the rows sum_i x_ij <= cap_j y_j for the facilities, and" << endl;
+    cout << "               add the rows x_ij <= y_j and the capacity cover when violated" << endl;
+    cout << "               (smaller model, for large instances). The default is to add all" << endl;
+    cout << "               rows x_ij <= y_j to the model (disaggregated formulation)." << endl << endl;
     cout << "Examples:" << endl;
     cout << "      " << argv[0] << " 100  30  15" << endl << endl;
     cout << "      " << argv[0] << " digr_cflp_1" << endl << endl;
+    cout << "      " << argv[0] << " cflp_200k.bin -aggregated" << endl << endl;
   exit(0);
   }
   DNodeStringMap vname(g);  // name of graph nodes
@@ -151,8 +509,8 @@ int main(int argc, char *argv[])
     nC = atoi(argv[1]);
     nF = atoi(argv[2]);
     Cap = atoi(argv[3]);
-    vector <DNode> Client(1000);
-    vector <DNode> Facility(1000);
+    vector <DNode> Client(nC);
+    vector <DNode> Facility(nF);
     for (int i=0;i<nC;i++) {
       Client[i] = g.addNode();
       px[Client[i]] = drand48()*100;
@@ -216,19 +574,22 @@ int main(int argc, char *argv[])
   // * Se i eh instalacao, ento sua capacidade eh de no mximo facility_capacity[i] clientes
   //   
 
+  // In the aggregated formulation the capacity row also links x and y, and
+  // the rows x[e] <= y[fac] are added by CFLP_LinkingCuts only when violated.
   for(DNodeIt v(g); v != INVALID; ++v) {
     if (vtype[v] == FACILITY) {
       GRBLinExpr num_customers = 0;
       for (InArcIt e(g, v); e != INVALID; ++e) {
         num_customers += x[e];
       }
-      model.addConstr(num_customers <= facility_capacity[v]);
+      if (aggregated) model.addConstr(num_customers <= facility_capacity[v]*y[v]);
+      else model.addConstr(num_customers <= facility_capacity[v]);
     } else if(vtype[v] == CLIENT) {
       GRBLinExpr num_facilities = 0;
       for(OutArcIt e(g, v); e != INVALID; ++e) {
           num_facilities += x[e];
           DNode fac = g.runningNode(e);
-          model.addConstr(x[e] <= y[fac]);
+          if (!aggregated) model.addConstr(x[e] <= y[fac]);
         }
       model.addConstr(num_facilities >= 1);
     }
@@ -238,7 +599,47 @@ int main(int argc, char *argv[])
   //                           Altere daqui para cima
   //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
   try {
+    // The Lagrangian relaxation gives a lower bound, a solution (start of
+    // the MIP, whose value is the cutoff) and facilities fixed closed/open.
+    CFLP_Lagrangian lag(g,vname,edge_weight,facility_weight,facility_capacity,vtype);
+    lag.Run(LAGRANGIAN_MAXIT);
+    if (lag.UpperBound < DBL_MAX) {
+      for (int j=0;j<lag.nF;j++) {
+	// a facility fixed open stays open in the start (its bound is LB=1)
+	y[lag.Facility[j]].set(GRB_DoubleAttr_Start,(lag.BestOpen[j] || (lag.Fixed[j] > 0)) ? 1.0 : 0.0);
+	if (lag.Fixed[j] < 0) y[lag.Facility[j]].set(GRB_DoubleAttr_UB,0.0);
+	if (lag.Fixed[j] > 0) y[lag.Facility[j]].set(GRB_DoubleAttr_LB,1.0);
+      }
+      for (ArcIt e(g); e != INVALID; ++e) x[e].set(GRB_DoubleAttr_Start,0.0);
+      for (int i=0;i<lag.nC;i++) x[lag.BestArc[i]].set(GRB_DoubleAttr_Start,1.0);
+      model.getEnv().set(GRB_DoubleParam_Cutoff,lag.UpperBound+MY_EPS);
+    }
+    // the callback keeps one entry per arc, so it is built only when used
+    CFLP_LinkingCuts *cb = NULL;
+    if (aggregated) {
+      cb = new CFLP_LinkingCuts(g,x,y,facility_capacity,vtype);
+      model.getEnv().set(GRB_IntParam_PreCrush, 1); // user cuts on the presolved model
+      model.setCallback(cb);
+    }
+    model.update();
     model.optimize();
+    if (cb) {
+      printf("[Aggregated] %d rows x_ij <= y_j and %d capacity covers added\n",cb->NLinking,cb->NCover);
+      delete cb;
+    }
+
+    // values of the solution (of the MIP, or the Lagrangian one if the MIP
+    // found no better solution)
+    ArcValueMap xval(g,0.0);
+    DNodeValueMap yval(g,0.0);
+    if (model.get(GRB_IntAttr_SolCount) > 0) {
+      for (ArcIt e(g); e != INVALID; ++e) xval[e] = x[e].get(GRB_DoubleAttr_X);
+      for (int j=0;j<lag.nF;j++) yval[lag.Facility[j]] = y[lag.Facility[j]].get(GRB_DoubleAttr_X);
+    } else if (lag.UpperBound < DBL_MAX) {
+      cout << "Lagrangian heuristic obtained optimum solution" << endl;
+      for (int i=0;i<lag.nC;i++) xval[lag.BestArc[i]] = 1.0;
+      for (int j=0;j<lag.nF;j++) yval[lag.Facility[j]] = lag.BestOpen[j];
+    }
 
     double total_weight = 0.0;
 
@@ -246,7 +647,7 @@ int main(int argc, char *argv[])
     for(DNodeIt v(g); v != INVALID; ++v) {
       switch(vtype[v]) {
       case FACILITY:
-        if (BinaryIsOne(y[v].get(GRB_DoubleAttr_X))) {
+        if (BinaryIsOne(yval[v])) {
           vcolor[v] = RED;
           total_weight += facility_weight[v];
         } else vcolor[v] = MAGENTA;
@@ -259,7 +660,7 @@ int main(int argc, char *argv[])
 
     /* colorindo arestas */
     for(ArcIt e(g); e != INVALID; ++e) {
-      if (BinaryIsOne(x[e].get(GRB_DoubleAttr_X))) {
+      if (BinaryIsOne(xval[e])) {
         total_weight += edge_weight[e];
         ecolor[e] = BLACK;
       } else ecolor[e] = NOCOLOR;
@@ -273,7 +674,7 @@ int main(int argc, char *argv[])
       if (vtype[v] == FACILITY) {
         int num_customers = 0;
         for (InArcIt e(g, v); e != INVALID; ++e) 
-	  if (BinaryIsOne(x[e].get(GRB_DoubleAttr_X))) num_customers++;
+	  if (BinaryIsOne(xval[e])) num_customers++;
         if (num_customers > facility_capacity[v]) {
           vcolor[v] = GREEN;
           capacity_ok = false;
@@ -281,10 +682,10 @@ int main(int argc, char *argv[])
       } else if(vtype[v] == CLIENT) {
         int num_facilities = 0;
         for(OutArcIt e(g, v); e != INVALID; ++e) {
-	  if (BinaryIsOne(x[e].get(GRB_DoubleAttr_X))) {
+	  if (BinaryIsOne(xval[e])) {
 	      num_facilities++;
             DNode fac = g.runningNode(e);
-            double facval = y[fac].get(GRB_DoubleAttr_X);
+            double facval = yval[fac];
             if (BinaryIsZero(facval)) 
               clients_connected_to_open = false;
           }
@@ -8,6 +8,12 @@
 #include <stdlib.h>
 #include <math.h>
 #include <queue>
+#include <algorithm>
+#include <functional>
+#include <fstream>
+#include <chrono>
+#include <unordered_map>
+#include <sstream>
 #include <lemon/list_graph.h>
 #include "mygraphlib.h"
 #include <string>
@@ -56,21 +62,269 @@ kPaths_Instance::kPaths_Instance(Digraph &graph,
   k = nk;
 }
 
+// Minimum cost k arc-disjoint s-t paths, as a minimum cost flow of value k
+// with unit capacities, by successive shortest paths: each of the k
+// augmentations sends one unit along a shortest s-t path of the residual
+// digraph, found by Dijkstra (binary heap) with the reduced costs
+// w(u,v)+pi(u)-pi(v) >= 0 given by the node potentials pi. The residual
+// digraph is kept in arrays indexed by the node and arc ids, built only once,
+// so many queries over the same digraph reuse the same memory.
+class KPathsSolver {
+public:
+  KPathsSolver(Digraph &g,ArcValueMap &weight);
+  // Return false if there are no k arc-disjoint s-t paths, or if there is a
+  // cycle of negative cost reachable from s (then NegativeCycle is true, and
+  // the problem must be solved by the linear program). If paths is false,
+  // only the cost is computed and Paths is left as it was.
+  bool Run(DNode s,DNode t,int k,bool paths=true);
+  bool NegativeCycle;         // Run found a cycle of negative cost
+  double Cost;                // cost of the k paths
+  vector<vector<Arc> > Paths; // the first k are the arcs of each path found by Run, from s to t
+private:
+  Digraph &g;
+  int n,m;
+  vector<Arc> Arcs;            // arc of each id
+  vector<int> Tail,Head;       // end nodes (ids) of each arc
+  vector<double> W;            // cost of each arc
+  bool NegativeCost;           // some arc has negative cost
+  vector<int> AdjStart,Adj;    // residual arcs of each node: 2a (arc a) or 2a+1 (arc a reversed)
+  vector<char> Flow;           // arcs with one unit of flow
+  vector<char> Used;           // arcs already in a path (decomposition of the flow)
+  vector<double> Pi,Dist;
+  vector<int> Pred;            // residual arc used to reach each node
+  vector<int> Pos,Walk;        // position of each node in Walk, the path being decomposed
+  vector<pair<double,int> > Heap;
+  bool InitPotentials(int s);
+  bool ShortestPath(int s,int t); // and augment one unit along it
+  void Decompose(int s,int t,int k);
+};
+
+KPathsSolver::KPathsSolver(Digraph &g,ArcValueMap &weight): g(g)
+{
+  n = g.maxNodeId()+1;  m = g.maxArcId()+1;
+  Arcs.resize(m);  Tail.assign(m,-1);  Head.assign(m,-1);  W.assign(m,0.0);
+  AdjStart.assign(n+1,0);
+  NegativeCost = false;
+  for (ArcIt a(g); a!=INVALID; ++a) {
+    int i=g.id(a);
+    Arcs[i] = a;  Tail[i] = g.id(g.source(a));  Head[i] = g.id(g.target(a));  W[i] = weight[a];
+    AdjStart[Tail[i]+1]++;  AdjStart[Head[i]+1]++;
+    if (W[i] < 0) NegativeCost = true;
+  }
+  for (int v=0;v<n;v++) AdjStart[v+1] += AdjStart[v];
+  Adj.resize(AdjStart[n]);
+  vector<int> next(AdjStart.begin(),AdjStart.end()-1);
+  for (int i=0;i<m;i++) {
+    if (Tail[i]<0) continue; // arc id not used
+    Adj[next[Tail[i]]++] = 2*i;
+    Adj[next[Head[i]]++] = 2*i+1;
+  }
+  Flow.resize(m);  Used.resize(m);
+  Pi.resize(n);  Dist.resize(n);  Pred.resize(n);  Pos.assign(n,-1);
+  Cost = 0.0;  NegativeCycle = false;
+}
+
+// Potentials that make the reduced costs nonnegative: zero if there is no
+// arc of negative cost, otherwise the distances from s (Bellman-Ford).
+bool KPathsSolver::InitPotentials(int s)
+{
+  fill(Pi.begin(),Pi.end(),0.0);
+  if (!NegativeCost) return(true);
+  fill(Dist.begin(),Dist.end(),DBL_MAX);
+  Dist[s] = 0.0;
+  for (int it=0;it<n;it++) {
+    bool changed=false;
+    for (int i=0;i<m;i++)
+      if ((Tail[i]>=0) && (Dist[Tail[i]]<DBL_MAX) && (Dist[Tail[i]]+W[i] < Dist[Head[i]]-MY_EPS))
+	{Dist[Head[i]] = Dist[Tail[i]]+W[i]; changed=true;}
+    if (!changed) {
+      for (int v=0;v<n;v++) if (Dist[v]<DBL_MAX) Pi[v]=Dist[v];
+      return(true);
+    }
+  }
+  return(false); // cycle of negative cost
+}
+
+bool KPathsSolver::ShortestPath(int s,int t)
+{
+  fill(Dist.begin(),Dist.end(),DBL_MAX);
+  Dist[s] = 0.0;  Pred[s] = -1;
+  Heap.clear();
+  Heap.push_back(make_pair(0.0,s));
+  while (!Heap.empty()) {
+    pop_heap(Heap.begin(),Heap.end(),greater<pair<double,int> >());
+    double d=Heap.back().first;
+    int u=Heap.back().second;
+    Heap.pop_back();
+    if (d > Dist[u]) continue; // old entry of u
+    if (u==t) break; // the other nodes are not needed
+    for (int i=AdjStart[u];i<AdjStart[u+1];i++) {
+      int r=Adj[i],a=r>>1,v;
+      double c;
+      if (r&1) { if (!Flow[a]) continue;  v=Tail[a];  c=-W[a]; }
+      else     { if (Flow[a]) continue;   v=Head[a];  c=W[a]; }
+      double dv = d+max(0.0,c+Pi[u]-Pi[v]);
+      if (dv < Dist[v]) {
+	Dist[v] = dv;  Pred[v] = r;
+	Heap.push_back(make_pair(dv,v));
+	push_heap(Heap.begin(),Heap.end(),greater<pair<double,int> >());
+      }
+    }
+  }
+  if (Dist[t]==DBL_MAX) return(false);
+  for (int v=0;v<n;v++) Pi[v] += min(Dist[v],Dist[t]);
+  for (int v=t;v!=s;) { // augment one unit along the path
+    int r=Pred[v],a=r>>1;
+    Flow[a] = !(r&1);
+    v = (r&1) ? Head[a] : Tail[a];
+  }
+  return(true);
+}
+
+// Split the flow in k paths. A cycle of the flow (of cost zero, as the flow
+// has minimum cost) found while walking from s is left out of the paths.
+void KPathsSolver::Decompose(int s,int t,int k)
+{
+  fill(Used.begin(),Used.end(),0);
+  if ((int) Paths.size() < k) Paths.resize(k); // keep the buffers of the other queries
+  for (int p=0;p<k;p++) {
+    int v=s;
+    Walk.clear();  Pos[s] = 0;
+    while (v!=t) {
+      int i=AdjStart[v];
+      while ((Adj[i]&1) || !Flow[Adj[i]>>1] || Used[Adj[i]>>1]) i++;
+      int a=Adj[i]>>1;
+      Used[a] = 1;  Walk.push_back(a);  v = Head[a];
+      if (Pos[v] < 0) {Pos[v] = (int) Walk.size(); continue;}
+      int keep=Pos[v]; // remove the cycle, that starts and ends at v
+      while ((int) Walk.size() > keep) {Pos[Head[Walk.back()]] = -1;  Walk.pop_back();}
+      Pos[v] = keep;
+    }
+    Pos[s] = -1;
+    Paths[p].clear();
+    for (unsigned i=0;i<Walk.size();i++) {
+      Pos[Head[Walk[i]]] = -1;
+      Paths[p].push_back(Arcs[Walk[i]]);
+    }
+  }
+}
+
+bool KPathsSolver::Run(DNode s,DNode t,int k,bool paths)
+{
+  int is=g.id(s),it=g.id(t);
+  fill(Flow.begin(),Flow.end(),0);
+  Cost = 0.0;  NegativeCycle = false;
+  if ((k<=0) || (is==it)) return(false);
+  if (!InitPotentials(is)) {NegativeCycle = true;  return(false);}
+  for (int p=0;p<k;p++)
+    if (!ShortestPath(is,it)) return(false);
+  // the cycles of the flow have cost zero, so the cost of the flow is the
+  // cost of the paths
+  for (int i=0;i<m;i++) if (Flow[i]) Cost += W[i];
+  if (paths) Decompose(is,it,k);
+  return(true);
+}
+
+// Solve the same problem by the linear program (the constraint matrix is
+// totally unimodular, so the basic optimal solution is integer). The arcs
+// of the solution are colored RED.
+bool kPaths_LP(kPaths_Instance &T,ArcColorMap &ecolor,double &soma)
+{
+  Digraph &g=T.g;
+  Digraph::ArcMap<GRBVar> x(g); // variables for each arc
+  GRBEnv env = GRBEnv();
+  GRBModel model = GRBModel(env);
+  model.getEnv().set(GRB_IntParam_Seed, 0);
+  model.set(GRB_StringAttr_ModelName, "Oriented k-Paths with GUROBI"); // prob. name
+  model.set(GRB_IntAttr_ModelSense, GRB_MINIMIZE); // is a minimization problem
+
+  // Add one variable for each arc and set its cost in the objective function
+  for (ArcIt e(g); e != INVALID; ++e) {
+    char name[100];
+    sprintf(name,"X_%s_%s",T.vname[g.source(e)].c_str(),T.vname[g.target(e)].c_str());
+    x[e] = model.addVar(0.0, 1.0, T.weight[e],GRB_CONTINUOUS,name); }
+  model.update(); // run update to use model inserted variables
+  try {
+    // Flow conservation: k units leave the source and arrive at the target
+    for (DNodeIt v(g); v!=INVALID; ++v) {
+      GRBLinExpr exprin, exprout;
+      for (InArcIt e(g,v); e != INVALID; ++e) exprin += x[e];
+      for (OutArcIt e(g,v); e != INVALID; ++e) exprout += x[e];
+
+      if (v==T.sourcenode)      model.addConstr(exprout - exprin == T.k );
+      else if (v==T.targetnode) model.addConstr(exprin - exprout == T.k );
+      else                model.addConstr(exprin - exprout == 0 );
+    }
+    model.optimize();
+
+    soma=0.0;
+    for (ArcIt e(g); e!=INVALID; ++e) {
+      if (BinaryIsOne(x[e].get(GRB_DoubleAttr_X))) {
+	soma += T.weight[e];
+	ecolor[e] = RED;
+      }else{
+	ecolor[e] = GRAY;
+      }
+    }
+  } catch (...) {return(false);}
+  return(true);
+}
+
+// Batch mode: the digraph is read only once and each query "<source_name>
+// <target_name> <k>" read from in is answered by a line "<source_name>
+// <target_name> <k> <cost>" (or "infeasible", or "negative cycle, use -lp"
+// if the solver can not be used for this source). The nodes are found by a hash
+// of their names and the same solver (and its memory) is used by all queries,
+// which only compute the cost. A malformed line is reported and skipped.
+int kPaths_Batch(Digraph &g,DNodeStringMap &vname,ArcValueMap &weight,istream &in)
+{
+  unordered_map<string,DNode> Name2Node;
+  string line,sname,tname,extra;
+  istringstream fields;
+  int k,nlines=0,nqueries=0,nsolved=0,nmalformed=0;
+  for (DNodeIt v(g);v!=INVALID;++v) Name2Node[vname[v]] = v;
+  KPathsSolver solver(g,weight);
+  chrono::steady_clock::time_point start=chrono::steady_clock::now();
+  while (getline(in,line)) {
+    nlines++;
+    fields.clear();  fields.str(line);
+    if (!(fields >> sname)) continue; // blank line
+    if (!(fields >> tname >> k) || (fields >> extra)) {
+      fprintf(stderr,"Malformed query in line %d: %s\n",nlines,line.c_str());
+      nmalformed++;
+      continue;
+    }
+    unordered_map<string,DNode>::const_iterator s=Name2Node.find(sname),t=Name2Node.find(tname);
+    nqueries++;
+    if ((s==Name2Node.end()) || (t==Name2Node.end()))
+      printf("%s %s %d unknown node\n",sname.c_str(),tname.c_str(),k);
+    else if (!solver.Run(s->second,t->second,k,false))
+      printf("%s %s %d %s\n",sname.c_str(),tname.c_str(),k,
+	     solver.NegativeCycle ? "negative cycle, use -lp" : "infeasible");
+    else {
+      printf("%s %s %d %.6f\n",sname.c_str(),tname.c_str(),k,solver.Cost);
+      nsolved++;
+    }
+  }
+  double elapsed=chrono::duration<double>(chrono::steady_clock::now()-start).count();
+  fprintf(stderr,"%d queries (%d feasible, %d malformed lines) in %.3f s\n",
+	  nqueries,nsolved,nmalformed,elapsed);
+  return 0;
+}
+
 int main(int argc, char *argv[]) 
 {
   int k,found;
+  bool lp;
+  double soma=0.0;
   Digraph g;  // graph declaration
   string digraph_kpaths_filename, source_node_name, target_node_name;
   DNodeStringMap vname(g);  // name of graph nodes
   DNodePosMap px(g),py(g);  // xy-coodinates for each node
   DNodeColorMap vcolor(g);// color of nodes
   ArcColorMap ecolor(g); // color of edges
-  ArcValueMap lpvar(g);    // used to obtain the contents of the LP variables
   ArcValueMap weight(g);   // edge weights
-  Digraph::ArcMap<GRBVar> x(g); // binary variables for each arc
-  vector <DNode> V;
   DNode sourcenode,targetnode;
-  int seed=0;
   srand48(1);
 
   // uncomment one of these lines to change default pdf reader, or insert new one
@@ -78,23 +332,34 @@ int main(int argc, char *argv[])
   //set_pdfreader("xpdf");    // pdf reader for Linux
   set_pdfreader("evince");  // pdf reader for Linux
   //set_pdfreader("open -a Skim.app");
-  // double cutoff;   // used to prune non promissing branches (of the B&B tree)
-  if (argc!=5) {cout<<endl<<"Usage: "<< argv[0]<<"  <digraph_kpaths_filename>  <source_node_name>  <target_node_name>  <k>"<< endl << endl;
-    cout << "Example:      " << argv[0] << " digr_triang_sparse_100 12 50 5" << endl << endl;
+  if ((argc>=3) && (argc<=4) && (string(argv[2])=="-batch")) {
+    ifstream queries;
+    if (argc==4) {
+      queries.open(argv[3]);
+      if (!queries.is_open()) {cout<<"Could not open the queries file "<<argv[3]<<endl;exit(0);}
+    }
+    if (!ReadListDigraph(argv[1],g,vname,weight,px,py,0))
+      {cout<<"Error reading digraph file "<<argv[1]<<"."<<endl;exit(0);}
+    return(kPaths_Batch(g,vname,weight,(argc==4) ? queries : cin));
+  }
+  if ((argc!=5) && ((argc!=6) || (string(argv[5])!="-lp"))) {
+    cout<<endl<<"Usage: "<< argv[0]<<"  <digraph_kpaths_filename>  <source_node_name>  <target_node_name>  <k>  [-lp]"<< endl;
+    cout<<"       "<< argv[0]<<"  <digraph_kpaths_filename>  -batch  [<queries_filename>]"<< endl << endl;
+    cout << "  -lp: solve by the linear program (GUROBI), instead of the min cost flow algorithm" << endl;
+    cout << "  -batch: answer many queries <source_node_name> <target_node_name> <k>, one per" << endl;
+    cout << "          line, read from the queries file (or the standard input)" << endl << endl;
+    cout << "Example:      " << argv[0] << " digr_triang_sparse_100 12 50 5" << endl;
+    cout << "              " << argv[0] << " digr_triang_sparse_100 -batch queries.txt" << endl << endl;
     exit(0);}
 
   digraph_kpaths_filename = argv[1];
   source_node_name = argv[2];
   target_node_name = argv[3];
   k = atoi(argv[4]);
+  lp = (argc==6);
 
-  GRBEnv env = GRBEnv();
-  GRBModel model = GRBModel(env);
-  model.getEnv().set(GRB_IntParam_Seed, seed);
-  model.set(GRB_StringAttr_ModelName, "Oriented k-Paths with GUROBI"); // prob. name
-  model.set(GRB_IntAttr_ModelSense, GRB_MINIMIZE); // is a minimization problem
-
-  ReadListDigraph(digraph_kpaths_filename,g,vname,weight,px,py,0);
+  if (!ReadListDigraph(digraph_kpaths_filename,g,vname,weight,px,py,0))
+    {cout<<"Error reading digraph file "<<digraph_kpaths_filename<<"."<<endl;exit(0);}
   found=0;
   for (DNodeIt v(g);v!=INVALID;++v)
     if(vname[v]==source_node_name){sourcenode=v;found=1;break;}
@@ -106,105 +371,35 @@ int main(int argc, char *argv[])
     
   kPaths_Instance T(g,vname,px,py,weight,sourcenode,targetnode,k);
   
-  //for (DNodeIt v(g);v!=INVALID;++v){ if(v==T.V[0])vcolor[v]=RED; else vcolor[v]=BLUE;}
-  //for (int i=1;i<T.nt;i++) vcolor[T.V[i]] = MAGENTA;
-  //for (ArcIt e(g); e != INVALID; ++e) ecolor[e] = BLUE;
-  //ViewListDigraph(g,vname,px,py,vcolor,ecolor,"Triangulated graph");
-  
-  // Generate the binary variables and the objective function
-  // Add one binary variable for each edge and set its cost in the objective function
-  for (ArcIt e(g); e != INVALID; ++e) {
-    char name[100];
-    sprintf(name,"X_%s_%s",vname[g.source(e)].c_str(),vname[g.target(e)].c_str());
-    x[e] = model.addVar(0.0, 1.0, weight[e],GRB_CONTINUOUS,name); }
-  model.update(); // run update to use model inserted variables
-  try {
-    //if (time_limit >= 0) model.getEnv().set(GRB_DoubleParam_TimeLimit,time_limit);
-    //model.getEnv().set(GRB_DoubleParam_ImproveStartTime,10); //try better sol. aft. 10s
-    // if (cutoff > 0) model.getEnv().set(GRB_DoubleParam_Cutoff, cutoff );
-    //model.write("model.lp"); system("cat model.lp");
-
-    // Add degree constraint for each node (sum of solution edges incident to a node is 2)
-    for (DNodeIt v(g); v!=INVALID; ++v) {
-      GRBLinExpr exprin, exprout;
-      for (InArcIt e(g,v); e != INVALID; ++e) exprin += x[e];
-      for (OutArcIt e(g,v); e != INVALID; ++e) exprout += x[e];
-
-      if (v==sourcenode)      model.addConstr(exprout - exprin == k );
-      else if (v==targetnode) model.addConstr(exprin - exprout == k );
-      else                model.addConstr(exprin - exprout == 0 );
+  for (DNodeIt v(g);v!=INVALID;++v) vcolor[v]=BLUE; // all nodes BLUE
+  vcolor[sourcenode]=RED; // change the colors of the source node
+  vcolor[targetnode]=RED; // and the target node to RED
+  if (lp) {
+    if (!kPaths_LP(T,ecolor,soma)) {cout << "Error solving the linear program" << endl; return 1;}
+  } else {
+    KPathsSolver solver(g,weight);
+    if (!solver.Run(sourcenode,targetnode,k)) {
+      if (solver.NegativeCycle)
+	{cout << "There is a cycle of negative cost reachable from " << source_node_name
+	      << ", use -lp to solve by the linear program" << endl; return 0;}
+      cout << "There are no " << k << " arc-disjoint paths from "
+	   << source_node_name << " to " << target_node_name << endl;
+      return 0;
     }
-
-    model.optimize();
-
-    double soma=0.0;
-    for (DNodeIt v(g);v!=INVALID;++v) vcolor[v]=BLUE; // all nodes BLUE
-    vcolor[sourcenode]=RED; // change the colors of the source node
-    vcolor[targetnode]=RED; // and the target node to RED
-    for (ArcIt e(g); e!=INVALID; ++e) {
-      if (BinaryIsOne(x[e].get(GRB_DoubleAttr_X))) {
-	soma += weight[e];
-	ecolor[e] = RED;
-      }else{
-	ecolor[e] = GRAY;
-      }
-    }
-    cout << "kPaths Tree Value = " << soma << endl;
-    /*
-    //------------------------------------------------------------------------------
-    // The following code was implemented by Lucas Prado Melo: coloring paths by bfs
-    bool ok = true;
-    for(int i=0; i < k && ok; i++) {
-      queue<DNode> q;
-      DNodeArcMap pre(g, INVALID);
-      q.push(sourcenode);
-      while (!q.empty()) {
-        DNode cur = q.front();
-        q.pop();
-        for(OutArcIt e(g, cur); e!=INVALID; ++e) {
-          DNode nxt = g.runningNode(e);
-          if ((pre[nxt]==INVALID) && (ecolor[e]==NOCOLOR) && (BinaryIsOne(lpvar[e]))){
-            pre[nxt] = e;
-            q.push(nxt);
-          }
-        }
-      }
-      if (pre[targetnode] == INVALID) ok = false;
-      else {
-        DNode x = targetnode;
-        while (x != sourcenode) {
-          ecolor[pre[x]] = 3+i%6; // use colors 3(RED) to 8(CYAN), see myutils.h
-          x = g.oppositeNode(x, pre[x]);
-        }
-      }
-    }
-    if (!ok) {cout << "Nao eh possivel encontrar os " << k << " caminhos!" << endl;}
-    //------------------------------------------------------------------------------
-    */
-    for(ArcIt e(g); e!=INVALID; ++e) {
-      if (BinaryIsOne(lpvar[e]) && ecolor[e]==NOCOLOR ) {
-        cout << "Alguma(s) aresta(s) nao pertencem a qualquer caminho!" << endl;
-        break;
+    soma = solver.Cost;
+    for (ArcIt e(g); e!=INVALID; ++e) ecolor[e] = GRAY;
+    for (int i=0;i<k;i++) {
+      cout << "Path " << i+1 << ": " << source_node_name;
+      for (unsigned j=0;j<solver.Paths[i].size();j++) {
+	ecolor[solver.Paths[i][j]] = 3+i%6; // use colors 3(RED) to 8(CYAN), see myutils.h
+	cout << " " << vname[g.target(solver.Paths[i][j])];
       }
+      cout << endl;
     }
-    for(ArcIt e(g); e!=INVALID; ++e)
-      if (NonBinary(lpvar[e])) ecolor[e] = GRAY;
-
-    for(ArcIt e(g); e!=INVALID; ++e) {
-      if (NonBinary(lpvar[e])) {
-        cout << "Alguma(s) aresta(s) possuem valor fracionario!"
-	  " (marcadas com cor cinza claro)" << endl;
-        break;
-      }
-    }
-    //-----------------------------------------------------------------
-
-
-    cout << "kPaths Tree Value = " << soma << endl;
-    ViewListDigraph(g,vname,px,py,vcolor,ecolor,
+  }
+  cout << "kPaths Tree Value = " << soma << endl;
+  ViewListDigraph(g,vname,px,py,vcolor,ecolor,
 	"minimum kPaths cost in graph with "+IntToString(T.nnodes)+
 	" nodes and "+IntToString(k)+" paths: "+DoubleToString(soma));
-  } catch (...) {cout << "Error during callback..." << endl; }
   return 0;
 }
-
@@ -12,8 +12,12 @@
 #include "myutils.h"
 #include <lemon/concepts/digraph.h>
 #include <lemon/preflow.h>
+#include <thread>
+#include <atomic>
 using namespace lemon;
 
+#define STEINER_MAXNESTED 10 // maximum number of nested cuts for each terminal
+
 
 // Para compilar:
 //  g++ -lemon geompack.cpp myutils.cpp  mygraphlib.cpp generate_steiner_file.cpp -o out
@@ -54,6 +58,181 @@ Steiner_Instance::Steiner_Instance(Digraph &graph,
   nt = nterm;
 }
 
+// Work space of one thread of SteinerSeparator: its own capacities (changed
+// by the nested cuts), max-flow solver and marks of the nodes.
+struct SteinerWorkspace {
+  SteinerWorkspace(Digraph &g) : capacity(g), solver(g,capacity) {}
+  ArcValueMap capacity;
+  DiMinCutSolver solver;
+  vector<char> Mark;
+  vector<int> Stack,Changed; // Changed has the arcs with capacity raised by nested cuts
+};
+
+// Separation of the cuts x(delta^+(S)) >= 1, for S with the root V[0] and
+// without some terminal. The buffers are kept between calls. First, the
+// nodes reachable from the root by arcs with x[a]>0 give a cut (of value 0)
+// if some terminal is not reached. The terminals reached by arcs with
+// x[a]==1 are skipped. For each other terminal t, a max-flow from the root
+// to t is computed. If its value is less than 1, the forward cut (S = nodes
+// reachable from the root in the residual graph) and the back cut (S = nodes
+// that cannot reach t) are violated. Nested cuts are obtained setting
+// the capacity of the arcs of the back cut to 1 and computing the max-flow
+// again, warm started from the previous flow (at most STEINER_MAXNESTED
+// times). The terminals are divided among NThreads threads, each one with
+// its own SteinerWorkspace. The node set S of the i-th cut found is
+// CutNodes[CutStart[i]..CutStart[i+1]-1] (node ids).
+class SteinerSeparator {
+public:
+  SteinerSeparator(Steiner_Instance &T,int NThreads);
+  ~SteinerSeparator();
+  int Separate(const double *xval); // xval is indexed by the arc ids. Return the number of cuts
+  vector<int> CutStart,CutNodes;
+private:
+  Steiner_Instance &T;
+  int NThreads;
+  const double *x;
+  vector<SteinerWorkspace*> W;
+  vector<char> Reach,ReachOne;
+  vector<int> Stack;
+  vector<int> Pending;      // terminals (index in T.V) that need a max-flow
+  atomic<int> NextPending;
+  vector<vector<int> > TermStart,TermNodes; // cuts of the i-th pending terminal
+  void Reachable(double threshold,vector<char> &R); // nodes reachable from the root by arcs with x[a]>threshold
+  void ResidualReach(SteinerWorkspace &w,DNode s,bool backward);
+  void SeparateTerminal(SteinerWorkspace &w,int i);
+  void Run(int k);
+};
+
+SteinerSeparator::SteinerSeparator(Steiner_Instance &T,int NThreads):
+  T(T), NThreads(max(1,NThreads))
+{
+  Digraph &g=T.g;
+  Reach.resize(g.maxNodeId()+1);  ReachOne.resize(g.maxNodeId()+1);
+  TermStart.resize(T.nt);  TermNodes.resize(T.nt);
+  if (T.nt<2) return;
+  for (int k=0;k<this->NThreads;k++) {
+    W.push_back(new SteinerWorkspace(g));
+    W[k]->Mark.resize(g.maxNodeId()+1);
+    W[k]->solver.MaxFlow(T.V[0],T.V[1]); // allocate the maps of the max-flow here, the threads must not attach maps to g
+  }
+}
+
+SteinerSeparator::~SteinerSeparator()
+{
+  for (unsigned k=0;k<W.size();k++) delete W[k];
+}
+
+void SteinerSeparator::Reachable(double threshold,vector<char> &R)
+{
+  Digraph &g=T.g;
+  fill(R.begin(),R.end(),0);
+  Stack.assign(1,g.id(T.V[0]));  R[Stack[0]]=1;
+  while (!Stack.empty()) {
+    DNode u=g.nodeFromId(Stack.back());  Stack.pop_back();
+    for (OutArcIt a(g,u); a!=INVALID; ++a) {
+      int v=g.id(g.target(a));
+      if (!R[v] && (x[g.id(a)] > threshold)) {R[v]=1;  Stack.push_back(v);}
+    }
+  }
+}
+
+// Mark the nodes reachable from s in the residual graph (or, if backward,
+// the nodes that can reach s)
+void SteinerSeparator::ResidualReach(SteinerWorkspace &w,DNode s,bool backward)
+{
+  Digraph &g=T.g;
+  fill(w.Mark.begin(),w.Mark.end(),0);
+  w.Stack.assign(1,g.id(s));  w.Mark[g.id(s)]=1;
+  while (!w.Stack.empty()) {
+    DNode u=g.nodeFromId(w.Stack.back());  w.Stack.pop_back();
+    for (OutArcIt a(g,u); a!=INVALID; ++a) {
+      int v=g.id(g.target(a));
+      double r = backward ? w.solver.Flow(a) : w.capacity[a]-w.solver.Flow(a);
+      if (!w.Mark[v] && (r > MY_EPS)) {w.Mark[v]=1;  w.Stack.push_back(v);}
+    }
+    for (InArcIt a(g,u); a!=INVALID; ++a) {
+      int v=g.id(g.source(a));
+      double r = backward ? w.capacity[a]-w.solver.Flow(a) : w.solver.Flow(a);
+      if (!w.Mark[v] && (r > MY_EPS)) {w.Mark[v]=1;  w.Stack.push_back(v);}
+    }
+  }
+}
+
+void SteinerSeparator::SeparateTerminal(SteinerWorkspace &w,int i)
+{
+  Digraph &g=T.g;
+  DNode r=T.V[0],t=T.V[Pending[i]];
+  vector<int> &Start=TermStart[i],&Nodes=TermNodes[i];
+  Start.assign(1,0);  Nodes.clear();  w.Changed.clear();
+  for (int nested=0;nested<STEINER_MAXNESTED;nested++) {
+    // the nested cuts only increase capacities, so the previous flow is still feasible
+    if (w.solver.MaxFlow(r,t,nested>0) >= 1.0-MY_EPS) break;
+    // forward cut: S has the nodes reachable from the root
+    ResidualReach(w,r,false);
+    int fsize=0;
+    for (DNodeIt v(g); v!=INVALID; ++v) if (w.Mark[g.id(v)]) {Nodes.push_back(g.id(v));  fsize++;}
+    Start.push_back((int) Nodes.size());
+    // back cut: S has the nodes that cannot reach t (it contains the forward cut)
+    ResidualReach(w,t,true);
+    int size=0;
+    for (DNodeIt v(g); v!=INVALID; ++v) if (!w.Mark[g.id(v)]) size++;
+    if (size!=fsize) { // not the same cut
+      for (DNodeIt v(g); v!=INVALID; ++v) if (!w.Mark[g.id(v)]) Nodes.push_back(g.id(v));
+      Start.push_back((int) Nodes.size());
+    }
+    // raise the arcs of the back cut to capacity 1, so the next max-flow can
+    // use them freely and its min cut is a different one
+    for (ArcIt a(g); a!=INVALID; ++a)
+      if (!w.Mark[g.id(g.source(a))] && w.Mark[g.id(g.target(a))] && (w.capacity[a] < 1.0)) {
+	w.capacity[a] = 1.0;  w.Changed.push_back(g.id(a));
+      }
+  }
+  for (unsigned k=0;k<w.Changed.size();k++) w.capacity[g.arcFromId(w.Changed[k])] = x[w.Changed[k]];
+}
+
+void SteinerSeparator::Run(int k)
+{
+  Digraph &g=T.g;
+  SteinerWorkspace &w=*W[k];
+  for (ArcIt a(g); a!=INVALID; ++a) w.capacity[a] = x[g.id(a)];
+  for (int i=NextPending++;i<(int) Pending.size();i=NextPending++) SeparateTerminal(w,i);
+}
+
+int SteinerSeparator::Separate(const double *xval)
+{
+  Digraph &g=T.g;
+  x = xval;
+  CutStart.assign(1,0);  CutNodes.clear();  Pending.clear();
+  if (T.nt<2) return(0);
+  Reachable(MY_EPS,Reach);
+  Reachable(1.0-MY_EPS,ReachOne);
+  bool unreached=false;
+  for (int i=1;i<T.nt;i++) {
+    int t=g.id(T.V[i]);
+    if (!Reach[t]) unreached=true;
+    else if (!ReachOne[t]) Pending.push_back(i);
+  }
+  if (unreached) { // the nodes reachable from the root give a cut of value 0
+    for (DNodeIt v(g); v!=INVALID; ++v) if (Reach[g.id(v)]) CutNodes.push_back(g.id(v));
+    CutStart.push_back((int) CutNodes.size());
+  }
+
+  // max-flows for the pending terminals, divided among the threads
+  int nthreads=min(NThreads,(int) Pending.size());
+  vector<thread> Threads;
+  NextPending = 0;
+  for (int k=1;k<nthreads;k++) Threads.push_back(thread(&SteinerSeparator::Run,this,k));
+  if (nthreads>0) Run(0);
+  for (unsigned k=0;k<Threads.size();k++) Threads[k].join();
+  for (int i=0;i<(int) Pending.size();i++) // cuts in the order of the terminals
+    for (unsigned j=0;j+1<TermStart[i].size();j++) {
+      CutNodes.insert(CutNodes.end(),TermNodes[i].begin()+TermStart[i][j],
+		      TermNodes[i].begin()+TermStart[i][j+1]);
+      CutStart.push_back((int) CutNodes.size());
+    }
+  return((int) CutStart.size()-1);
+}
+
 // This cutting plane routine inserts finds violated cuts between the root and the other terminals.
 // Any cut separating the root from the other terminals must have capacity at least 1
 // This is a user cut. That is, it is called when the variables x are still fractionary
@@ -63,9 +242,17 @@ class ConnectivityCuts: public GRBCallback
   Steiner_Instance &T;
   ListDigraph::ArcMap<GRBVar>& x;
   double (GRBCallback::*solution_value)(GRBVar);
+  vector<GRBVar> xid;    // variables indexed by the arc ids
+  vector<double> xidval; // values of the variables indexed by the arc ids
+  vector<int> Cuts;
+  SteinerSeparator sep;
 public:
-  ConnectivityCuts(Steiner_Instance &T, Digraph::ArcMap<GRBVar>& x) : T(T),x(x)
-  {    }
+  CutPool Pool; // connectivity cuts already added
+  ConnectivityCuts(Steiner_Instance &T, Digraph::ArcMap<GRBVar>& x,
+		   int NThreads=thread::hardware_concurrency()) : T(T),x(x),sep(T,NThreads),Pool(T.g)
+  { xid.resize(T.g.maxArcId()+1);  xidval.resize(T.g.maxArcId()+1);
+    for (ArcIt a(T.g); a!=INVALID; ++a) xid[T.g.id(a)] = x[a];
+  }
 protected:
   void callback()
   {
@@ -73,24 +260,26 @@ protected:
     else if (where==GRB_CB_MIPNODE && getIntInfo(GRB_CB_MIPNODE_STATUS)==GRB_OPTIMAL) {
       solution_value = &ConnectivityCuts::getNodeRel;
     } else return;
+    Pool.StartCallback();
     try {
       Digraph &g = T.g;
-      ArcValueMap capacity(g);
-      DCutMap cut(g);
-      double vcut;
-      for (ArcIt a(g); a!=INVALID; ++a) 
-	capacity[a] = (this->*solution_value)(x[a]);  // or getSolution(x[a]);
+      for (ArcIt a(g); a!=INVALID; ++a)
+	xidval[g.id(a)] = (this->*solution_value)(x[a]);  // or getSolution(x[a]);
       
-      for (int i=1;i< T.nt;i++) {
+      // Use the violated cuts of the pool, and run the max-flows only if there is none
+      Cuts.clear();
+      if (!Pool.FindViolated(&xidval[0],Cuts)) {
+	int ncuts = sep.Separate(&xidval[0]);
+	for (int i=0;i<ncuts;i++) {
+	  vector<int> S(sep.CutNodes.begin()+sep.CutStart[i],sep.CutNodes.begin()+sep.CutStart[i+1]);
+	  int c = Pool.Add(S,1.0);
+	  if (c>=0) Cuts.push_back(c);
+	}
+      }
+      for (unsigned i=0;i<Cuts.size();i++) {
 	GRBLinExpr expr;
-	// find a mincut between root V[0] and other terminal
-	vcut = DiMinCut(g,capacity, T.V[0] , T.V[i], cut);
-	if (vcut >= 1.0-MY_EPS) continue;
-
-	// found violated cut
-	for (ArcIt a(g); a!=INVALID; ++a) 
-	  if ((cut[g.source(a)]==cut[T.V[0]]) && (cut[g.target(a)]!=cut[T.V[0]]))
-	    expr += x[a];
+	const int *a=Pool.Edges(Cuts[i]);
+	for (int j=0;j<Pool.NEdges(Cuts[i]);j++) expr += xid[a[j]];
 	addLazy( expr >= 1.0 ); // or addLazy(expr,GRB_GREATER_EQUAL,1.0);
       }
     } catch (GRBException e) {
@@ -99,6 +288,7 @@ protected:
     } catch (...) {
       cout << "Error during callback**" << endl;
     }
+    Pool.EndCallback();
   }
 };
 
@@ -188,7 +378,7 @@ int main(int argc, char *argv[])
     //model.getEnv().set(GRB_DoubleParam_ImproveStartTime,10); //try better sol. aft. 10s
     // if (cutoff > 0) model.getEnv().set(GRB_DoubleParam_Cutoff, cutoff );
 
-    ConnectivityCuts cb = ConnectivityCuts(T , x);
+    ConnectivityCuts cb(T , x);
     model.setCallback(&cb);
     model.update();
     //model.write("model.lp"); system("cat model.lp");
@@ -203,6 +393,7 @@ int main(int argc, char *argv[])
       if (BinaryIsOne(lpvar[e])) { soma += weight[e]; ecolor[e] = RED; }
       else ecolor[e] = NOCOLOR; }
     cout << "Steiner Tree Value = " << soma << endl;
+    cb.Pool.PrintStatistics("Connectivity cuts");
     ViewListDigraph(g,vname,px,py,vcolor,ecolor,
 	"Steiner Tree cost in graph with "+IntToString(T.nnodes)+
 	" nodes and "+IntToString(T.nt)+" terminals: "+DoubleToString(soma));
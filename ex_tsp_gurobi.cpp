@@ -23,6 +23,12 @@
 #include <math.h>
 #include <cassert>
 #include <set>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <unordered_map>
+#include <climits>
 #include <lemon/list_graph.h>
 #include <lemon/unionfind.h>
 #include <lemon/gomory_hu.h>
@@ -34,6 +40,29 @@
 // there are some differences from Gurobi Version 5.5, see below
 #define GUROBI_NEWVERSION 1  
 
+// parameters of the local search heuristic
+#define LK_MAXDEPTH 6          // maximum number of levels of a Lin-Kernighan move
+#define DOUBLEBRIDGE_MAXSEG 50 // maximum size of the segments of a double bridge kick
+
+// initial core of the sparse model (besides the Delaunay triangulation)
+#define TSP_SPARSE_KNN 8       // number of nearest neighbours of each node
+
+// Candidate lists used by the local search: Candidates[i*k..i*k+k-1] are the k nearest
+// neighbours of node i (indices of A), in nondecreasing order of cost.
+// Non-edges are never candidates (the list is completed with -1).
+void BuildCandidateLists(AdjacencyMatrix &A,int k,vector<int> &Candidates);
+
+// Cost of the edges of the TSP, between nodes given by indices 0..n-1. It is
+// given by an adjacency matrix (complete model) or by the points of an
+// euclidean graph (sparse model, where the graph has only some of the edges).
+class TSP_Costs {
+public:
+  TSP_Costs() : A(NULL), E(NULL) {}
+  AdjacencyMatrix *A;
+  EuclideanGraph *E;
+  inline double Cost(int i,int j) const { return(A ? A->Cost(i,j) : E->Cost(i,j)); }
+};
+
 // This is the type used to obtain the pointer to the problem data. This pointer
 // is stored in the branch and cut tree. And when we define separation routines,
 // we can recover the pointer and access the problem data again.
@@ -44,9 +73,20 @@ public:
 	   NodePosMap &posicaox,
 	   NodePosMap &posy,
 	   EdgeValueMap &eweight);
+  // Sparse model: graph has only some of the edges of the complete euclidean
+  // graph eg, and the node of the point i is Index2Node[i].
+  TSP_Data(ListGraph &graph,
+	   NodeStringMap &nodename,
+	   NodePosMap &posicaox,
+	   NodePosMap &posy,
+	   EdgeValueMap &eweight,
+	   EuclideanGraph &eg,
+	   vector<Node> &Index2Node);
+  ~TSP_Data();
   ListGraph &g;
   int NNodes,NEdges;
-  int max_perturb2opt_it; // maximum number of iterations for heuristic Perturb2OPT
+  int max_ils_it; // maximum number of iterations for heuristic TSP_IteratedLocalSearch
+  int NThreads;   // number of threads used by TSP_IteratedLocalSearch
   NodeStringMap &vname;
   EdgeStringMap ename;
   NodeColorMap vcolor;
@@ -54,9 +94,23 @@ public:
   EdgeValueMap &weight;
   NodePosMap &posx;
   NodePosMap &posy;
-  AdjacencyMatrix AdjMat; // adjacency matrix
-  vector<Node> BestCircuit; // vector containing the best circuit found
+  AdjacencyMatrix *AdjMat; // adjacency matrix (NULL in the sparse model)
+  TSP_Costs Costs; // costs between all pairs of node indices
+  vector<Node> Index2Node; // node of each index (the same indices of AdjMat)
+  NodeIntMap Node2Index;
+  vector<Edge> Index2Edge; // edges of g, in the order of the indices of the edges
+  int NCandidates; // number of nearest neighbours of each node used by the local search
+  vector<int> Candidates; // candidate lists, with node indices
+  TSPTour BestTour; // best circuit found, with node indices
   double BestCircuitValue;
+  mutex BestTourLock; // guards BestTour and BestCircuitValue while the heuristic threads run
+  // Sparse model: add the edge between the nodes of indices i and j to g
+  // (if it is not there) and return its index.
+  int AddEdge(int i,int j);
+  bool HasEdge(int i,int j) const
+  { return(EdgeSet.count((long long) min(i,j)*NNodes+max(i,j))>0); }
+private:
+  unordered_map<long long,int> EdgeSet; // index of the edge of each pair i*NNodes+j, i<j (sparse model)
 };
 
 TSP_Data::TSP_Data(ListGraph &graph,
@@ -72,13 +126,76 @@ TSP_Data::TSP_Data(ListGraph &graph,
   weight(eweight),
   posx(posicaox),
   posy(posicaoy),
-  AdjMat(graph,eweight,MY_INF), //
-  BestCircuit(countEdges(graph)) 
+  Node2Index(graph)
 {
   NNodes=countNodes(this->g);
   NEdges=countEdges(this->g);
   BestCircuitValue = DBL_MAX;
-  max_perturb2opt_it = 3000; // default value
+  max_ils_it = 3000; // default value
+  NThreads = max(1,(int) thread::hardware_concurrency()); // default value
+  AdjMat = new AdjacencyMatrix(graph,eweight,MY_INF);
+  Costs.A = AdjMat;
+  Index2Node.assign(AdjMat->Index2Node,AdjMat->Index2Node+NNodes);
+  for (int i=0;i<NNodes;i++) Node2Index[Index2Node[i]] = i;
+  Index2Edge.assign(AdjMat->Index2Edge,AdjMat->Index2Edge+NEdges);
+  NCandidates = 10; // default value
+  BuildCandidateLists(*AdjMat,NCandidates,Candidates);
+}
+
+TSP_Data::TSP_Data(ListGraph &graph,
+		   NodeStringMap &nodename,
+		   NodePosMap &posicaox,
+		   NodePosMap &posicaoy,
+		   EdgeValueMap &eweight,
+		   EuclideanGraph &eg,
+		   vector<Node> &Index2Node):
+  g(graph),
+  vname(nodename),
+  ename(graph),
+  vcolor(graph),
+  ecolor(graph),
+  weight(eweight),
+  posx(posicaox),
+  posy(posicaoy),
+  Index2Node(Index2Node),
+  Node2Index(graph)
+{
+  NNodes=countNodes(this->g);
+  NEdges=0;
+  BestCircuitValue = DBL_MAX;
+  max_ils_it = 3000; // default value
+  NThreads = max(1,(int) thread::hardware_concurrency()); // default value
+  AdjMat = NULL;
+  Costs.E = &eg;
+  for (int i=0;i<NNodes;i++) Node2Index[Index2Node[i]] = i;
+  for (EdgeIt e(g); e!=INVALID; ++e) {
+    int i=Node2Index[g.u(e)],j=Node2Index[g.v(e)];
+    EdgeSet[(long long) min(i,j)*NNodes+max(i,j)] = NEdges++;
+    Index2Edge.push_back(e);
+  }
+  NCandidates = 10; // default value
+  if (eg.Ncandidates < NCandidates) eg.BuildCandidates(NCandidates);
+  NCandidates = min(NCandidates,eg.Ncandidates);
+  Candidates.resize((size_t) NNodes*NCandidates);
+  for (int i=0;i<NNodes;i++)
+    for (int l=0;l<NCandidates;l++) Candidates[(size_t) i*NCandidates+l] = eg.Candidates(i)[l];
+}
+
+TSP_Data::~TSP_Data()
+{
+  delete AdjMat;
+}
+
+int TSP_Data::AddEdge(int i,int j)
+{
+  long long key=(long long) min(i,j)*NNodes+max(i,j);
+  unordered_map<long long,int>::iterator it=EdgeSet.find(key);
+  if (it!=EdgeSet.end()) return(it->second);
+  Edge e = g.addEdge(Index2Node[i],Index2Node[j]);
+  weight[e] = Costs.Cost(i,j);
+  Index2Edge.push_back(e);
+  EdgeSet[key] = NEdges;
+  return(NEdges++);
 }
 
 
@@ -90,53 +207,180 @@ string IntToString2(int x)
 { std::ostringstream oss; oss << x; return(oss.str()); }
 
 
-bool Heuristic_2_OPT(AdjacencyMatrix &A,vector<Node> &Circuit,double &BestCircuitValue, int &NNodesCircuit)
+void BuildCandidateLists(AdjacencyMatrix &A,int k,vector<int> &Candidates)
 {
-  double CurrentWeight=0.0,Remove,Insert;
-  bool globalimproved,improved;
-  vector<Node> CircuitAux(NNodesCircuit);
-  int i,j,k,l;
-  for (int i=0;i<NNodesCircuit-1;i++) 
-    CurrentWeight += A.Cost(Circuit[i],Circuit[i+1]);
-  CurrentWeight += A.Cost(Circuit[NNodesCircuit-1],Circuit[0]);
-
-  i=0;
-  globalimproved = false;
-  do {
-    int i1,i2,j1,j2;
-    improved=false;
-    i1 = i;
-    do {
-      // one edge is (i1 , i1+1)
-      i2 = (i1+1)%NNodesCircuit;
-      for (j=2;j<NNodesCircuit-1;j++) {
-	j1 = (i1+j)%NNodesCircuit;
-	j2 = (j1+1)%NNodesCircuit;
-	Remove = A.Cost(Circuit[i1],Circuit[i2])+A.Cost(Circuit[j1],Circuit[j2]);
-	Insert = A.Cost(Circuit[i1],Circuit[j1])+A.Cost(Circuit[i2],Circuit[j2]);
-	if (Remove-Insert > 0) {
-	  k = 0;
-	  CircuitAux[k++] = Circuit[i1];
-	  for (l=j1;l!=i1;l=(l-1+NNodesCircuit)%NNodesCircuit)
-	    CircuitAux[k++] = Circuit[l];
-	  for (l=j2;l!=i1;l=(l+1)%NNodesCircuit)
-	    CircuitAux[k++] = Circuit[l];
-
-	  for (k=0;k<NNodesCircuit;k++) Circuit[k] = CircuitAux[k];
-	  CurrentWeight = CurrentWeight - Remove + Insert;
-	  if (CurrentWeight < BestCircuitValue-MY_EPS) {
-	    BestCircuitValue = CurrentWeight;
-	    globalimproved = true;
+  int n=A.Nnodes;
+  vector<pair<double,int> > row;
+  Candidates.assign((size_t) n*k,-1);
+  for (int i=0;i<n;i++) {
+    row.clear();
+    for (int j=0;j<n;j++)
+      if ((j!=i)&&(A.Cost(i,j)<A.NonEdgeValue)) row.push_back(make_pair(A.Cost(i,j),j));
+    int m=min(k,(int) row.size());
+    partial_sort(row.begin(),row.begin()+m,row.end());
+    for (int l=0;l<m;l++) Candidates[(size_t) i*k+l] = row[l].second;
+  }
+}
+
+// Lin-Kernighan style move starting at t1: remove the edge (t1,t2) and, at
+// each level, insert an edge (t2,t3) with t3 a candidate of t2 and remove
+// the edge (t3,t4) that closes a tour with (t4,t1). Each level is a 2OPT
+// move, the partial gain must stay positive and the removed/inserted edges
+// are not inserted/removed again. The best prefix of the sequence is kept.
+// The nodes of the kept moves are added to Touched and the decrease of the
+// cost is added to Gain.
+bool LKMove(TSP_Costs &A,vector<int> &Candidates,int K,
+	    TSPTour &T,int t1,vector<int> &Touched,double &Gain)
+{
+  int t2,t3,t4,NAdded,NRemoved;
+  pair<int,int> Added[LK_MAXDEPTH],Removed[LK_MAXDEPTH+1];
+  int Moves[3*LK_MAXDEPTH]; // t2,t3,t4 of each level
+  for (int dir=0;dir<2;dir++) {
+    t2 = T.Next(t1,dir);
+    double Open=A.Cost(t1,t2),BestGain=MY_EPS;
+    int BestDepth=0,Depth;
+    NAdded=0;  NRemoved=0;
+    Removed[NRemoved++]=make_pair(min(t1,t2),max(t1,t2));
+    for (Depth=0;Depth<LK_MAXDEPTH;Depth++) {
+      // t4 is the neighbour of t3 in the same side t2 is of t1
+      int side=(T.Next(t1)==t2) ? 1 : 0,BestT3=-1,BestT4=-1;
+      double BestValue=-DBL_MAX;
+      for (int l=0;l<K;l++) {
+	int c=Candidates[(size_t) t2*K+l];
+	if (c<0) break;
+	double g1=Open-A.Cost(t2,c);
+	if (g1<=MY_EPS) break; // the next candidates are farther from t2
+	if ((c==t1)||(c==T.Next(t2,0))||(c==T.Next(t2,1))) continue;
+	int d=T.Next(c,side);
+	pair<int,int> in(min(t2,c),max(t2,c)),out(min(c,d),max(c,d));
+	if (find(Removed,Removed+NRemoved,in)!=Removed+NRemoved) continue;
+	if (find(Added,Added+NAdded,out)!=Added+NAdded) continue;
+	if (g1+A.Cost(c,d)>BestValue) {BestValue=g1+A.Cost(c,d); BestT3=c; BestT4=d;}
+      }
+      if (BestT3<0) break;
+      t3=BestT3;  t4=BestT4;
+      T.Make2OptMove(t1,t2,t4,t3);
+      Added[NAdded++]=make_pair(min(t2,t3),max(t2,t3));
+      Removed[NRemoved++]=make_pair(min(t3,t4),max(t3,t4));
+      Moves[3*Depth]=t2;  Moves[3*Depth+1]=t3;  Moves[3*Depth+2]=t4;
+      Open = BestValue;
+      t2 = t4;
+      if (Open-A.Cost(t1,t2)>BestGain) {BestGain=Open-A.Cost(t1,t2); BestDepth=Depth+1;}
+    }
+    // undo the moves after the best prefix
+    for (int k=Depth-1;k>=BestDepth;k--)
+      T.Make2OptMove(t1,Moves[3*k+2],Moves[3*k],Moves[3*k+1]);
+    if (BestDepth>0) {
+      Touched.push_back(t1);
+      for (int k=0;k<3*BestDepth;k++) Touched.push_back(Moves[k]);
+      Gain += BestGain;
+      return(true);
+    }
+  }
+  return(false);
+}
+
+// Return true if v is in the segment from s1 to s2 (following Next(.,dir))
+inline bool InSegment(TSPTour &T,int s1,int s2,int dir,int v)
+{ return(dir==0 ? T.Between(s1,v,s2) : T.Between(s2,v,s1)); }
+
+// Or-opt move: move a segment of 1 to 3 nodes starting at s1 to another
+// position of the tour (between a candidate c of one of its ends and a
+// neighbour d of c), possibly reversed. Done with two or three 2OPT moves.
+// The decrease of the cost is added to Gain.
+bool OrOptMove(TSP_Costs &A,vector<int> &Candidates,int K,
+	       TSPTour &T,int s1,vector<int> &Touched,double &Gain)
+{
+  int n=T.Nnodes();
+  for (int dir=0;dir<2;dir++) {
+    int s2=s1;
+    for (int L=1;L<=3 && L+3<=n;L++) {
+      if (L>1) s2 = T.Next(s2,dir);
+      int p=T.Next(s1,1-dir),nx=T.Next(s2,dir);
+      double RemoveGain=A.Cost(p,s1)+A.Cost(s2,nx)-A.Cost(p,nx),BestGain=MY_EPS;
+      int BestC=-1,BestD=-1,BestEnd=-1;
+      if (RemoveGain<=MY_EPS) continue;
+      for (int e=0;e<2;e++) {
+	int end=(e==0) ? s1 : s2,other=(e==0) ? s2 : s1;
+	for (int l=0;l<K;l++) {
+	  int c=Candidates[(size_t) end*K+l];
+	  if (c<0) break;
+	  if (A.Cost(end,c)>=RemoveGain) break;
+	  if (InSegment(T,s1,s2,dir,c)) continue; // c cannot be in the segment
+	  for (int side=0;side<2;side++) {
+	    int d=T.Next(c,side);
+	    if (InSegment(T,s1,s2,dir,d)) continue;
+	    if ((c==p && d==nx)||(c==nx && d==p)) continue;
+	    double gain=RemoveGain+A.Cost(c,d)-A.Cost(c,end)-A.Cost(other,d);
+	    if (gain>BestGain) {BestGain=gain; BestC=c; BestD=d; BestEnd=end;}
 	  }
-	  improved = true; 
 	}
       }
-      i1=(i1+1)%NNodesCircuit;
-    } while (i1!=i);
-    i = (i+1)%NNodesCircuit;
-  }while (improved);
-  if (globalimproved) cout << "[Heuristic: 2OPT] New Solution of value " << BestCircuitValue << "\n";
-  return(globalimproved);
+      if (BestC<0) continue;
+      int c=BestC,d=BestD;
+      bool CtoS2=(BestEnd==s2);
+      if (T.Next(c,dir)!=d) { swap(c,d); CtoS2=!CtoS2; } // now d follows c
+      if (d==p) continue; // the same as moving p to the other side of the segment
+      T.Make2OptMove(p,s1,c,d);   // p c ... nx s2 ... s1 d
+      T.Make2OptMove(p,c,nx,s2);  // p nx ... c s2 ... s1 d
+      if (!CtoS2) T.Make2OptMove(c,s2,s1,d); // p nx ... c s1 ... s2 d
+      int t[6]={p,nx,s1,s2,c,d};
+      Touched.insert(Touched.end(),t,t+6);
+      Gain += BestGain;
+      return(true);
+    }
+  }
+  return(false);
+}
+
+double TourCost(TSP_Costs &A,TSPTour &T)
+{
+  double Cost=0.0;
+  for (int i=0,v=0;i<T.Nnodes();i++,v=T.Next(v)) Cost += A.Cost(v,T.Next(v));
+  return(Cost);
+}
+
+// Local search with Lin-Kernighan style moves and Or-opt moves, using
+// candidate lists and don't look bits. Only the nodes in Active are
+// examined at first; the nodes of each improving move are examined again.
+// Return the decrease of the cost of the tour.
+double TSP_LocalSearch(TSP_Costs &A,vector<int> &Candidates,int K,
+		       TSPTour &T,vector<int> &Active)
+{
+  int n=T.Nnodes();
+  double Gain=0.0;
+  vector<char> InQueue(n,0);
+  vector<int> Touched;
+  deque<int> Queue;
+  if (n<5) return(0.0);
+  for (unsigned l=0;l<Active.size();l++)
+    if (!InQueue[Active[l]]) {InQueue[Active[l]]=1; Queue.push_back(Active[l]);}
+  while (!Queue.empty()) {
+    int a=Queue.front();
+    Queue.pop_front();  InQueue[a]=0;
+    Touched.clear();
+    if (LKMove(A,Candidates,K,T,a,Touched,Gain) ||
+	OrOptMove(A,Candidates,K,T,a,Touched,Gain))
+      for (unsigned l=0;l<Touched.size();l++)
+	if (!InQueue[Touched[l]]) {InQueue[Touched[l]]=1; Queue.push_back(Touched[l]);}
+  }
+  return(Gain);
+}
+
+bool Heuristic_LocalSearch(TSP_Data &tsp,TSPTour &T,double &BestCircuitValue)
+{
+  TSP_Costs &A=tsp.Costs;
+  double CurrentWeight;
+  vector<int> Active;
+  T.Sequence(Active);
+  TSP_LocalSearch(A,tsp.Candidates,tsp.NCandidates,T,Active);
+  CurrentWeight = TourCost(A,T);
+  if (CurrentWeight < BestCircuitValue-MY_EPS) {
+    BestCircuitValue = CurrentWeight;
+    cout << "[Heuristic: LocalSearch] New Solution of value " << BestCircuitValue << "\n";
+    return(true);
+  }
+  return(false);
 }
 
 // This routine must be called when the vector x (indexed on the edges) is integer.
@@ -144,49 +388,37 @@ bool Heuristic_2_OPT(AdjacencyMatrix &A,vector<Node> &Circuit,double &BestCircui
 // The vector x must represent a circuit (must be conected)
 bool Update_Circuit(TSP_Data &tsp, ListGraph::EdgeMap<GRBVar>& x)
 {
-  NodeNodeMap Adj1(tsp.g), Adj2(tsp.g);
   double CircuitValue;
-  Node FirstNode=INVALID,u,ant;
-  int n,i,NNodesCircuit;
+  int n,i,u,ant,NNodesCircuit;
+  // Adj1[v] and Adj2[v] have the two adjacent nodes of v in the circuit (node indices)
+  vector<int> Adj1(tsp.NNodes,-1),Adj2(tsp.NNodes,-1),Circuit(tsp.NNodes);
   
   NNodesCircuit=0; // used to count nodes, only to verify correctness
-  // Adj1[v] and Adj2[v] have the two adjacent nodes of v in the circuit
-  for (NodeIt v(tsp.g); v != INVALID; ++v) { Adj1[v]=INVALID; Adj2[v]=INVALID; }
   CircuitValue = 0.0;
   for (EdgeIt e(tsp.g); e != INVALID; ++e) { 
     assert(!(NonBinary(x[e].get(GRB_DoubleAttr_X)))); //f cannot be fractional;}
     if (BinaryIsOne(x[e].get(GRB_DoubleAttr_X))) {  // if the edge is in the solution
-      Node u,v;
+      int u,v;
       NNodesCircuit++;
-      u = (tsp.g.u(e)); v = (tsp.g.v(e));   // then, obtain the edge nodes u and v
+      u = tsp.Node2Index[tsp.g.u(e)]; v = tsp.Node2Index[tsp.g.v(e)]; // then, obtain the edge nodes u and v
       CircuitValue += tsp.weight[e];
-      assert((Adj1[u]==INVALID)||(Adj2[u]==INVALID));
-      assert((Adj1[v]==INVALID)||(Adj2[v]==INVALID));  // and say that
-      if (Adj1[u]==INVALID) Adj1[u] = v; else Adj2[u] = v; // v is adjacent to u
-      if (Adj1[v]==INVALID) Adj1[v] = u; else Adj2[v] = u; // and u is adj. to v
+      assert((Adj1[u]==-1)||(Adj2[u]==-1));
+      assert((Adj1[v]==-1)||(Adj2[v]==-1));  // and say that
+      if (Adj1[u]==-1) Adj1[u] = v; else Adj2[u] = v; // v is adjacent to u
+      if (Adj1[v]==-1) Adj1[v] = u; else Adj2[v] = u; // and u is adj. to v
     }
   }
   //cout << "CircuitValue = " << CircuitValue << " BestPrevious = "<< tsp.BestCircuitValue << endl;
   if (CircuitValue > tsp.BestCircuitValue-MY_EPS) return(false);
   // First verify if the circuit is valid
   assert (NNodesCircuit==tsp.NNodes);
-  for (NodeIt v(tsp.g); v != INVALID; ++v) {
-    assert((Adj1[v]!=INVALID) && (Adj2[v]!=INVALID));
-    // cout << "V_" << tsp.vname[v];
-    // if (Adj1[v]!=INVALID) cout << " Adj1[ V_" << tsp.vname[v] << " ] = "<< tsp.vname[Adj1[v]];
-    // else cout << " Adj1[ V_" << tsp.vname[v] << " ] = INV";
-    // if (Adj2[v]!=INVALID) cout << " Adj2[ V_" << tsp.vname[v] << " ] = "<< tsp.vname[Adj2[v]];
-    // else cout << " Adj2[ V_" << tsp.vname[v] << " ] = INV";
-    // cout << endl;
-  }
-
-  // find one node of the circuit
-  for (NodeIt v(tsp.g); v != INVALID; ++v) {FirstNode = v; break;}
-  
-  n = 1;     ant = FirstNode;     u = Adj1[FirstNode];
-  // verify if each node have two adjacent nodes
-  while (u!=FirstNode) {
-    assert(u!=INVALID);
+  for (i=0;i<tsp.NNodes;i++) assert((Adj1[i]!=-1) && (Adj2[i]!=-1));
+
+  // walk in the circuit from node 0, verifying if it visits all nodes
+  n = 1;     ant = 0;     u = Adj2[0];     Circuit[0] = 0;
+  while (u!=0) {
+    assert(u!=-1);
+    if (n<tsp.NNodes) Circuit[n] = u;
     if (Adj1[u]==ant) {ant = u; u=Adj2[u];} else {assert(Adj2[u]==ant); ant=u; u=Adj1[u]; }
     n++;
   }
@@ -195,160 +427,552 @@ bool Update_Circuit(TSP_Data &tsp, ListGraph::EdgeMap<GRBVar>& x)
 
   // the circuit is ok. So, update the best circuit (remember that at this point
   tsp.BestCircuitValue = CircuitValue; // the new circuit is better than the 
-  i = 1;                               // previous best circuit
-  tsp.BestCircuit[0] = FirstNode;
-  u = Adj2[FirstNode];
-  ant = FirstNode;
-  while (u!=FirstNode) {
-    tsp.BestCircuit[i] = u;      i++;
-    if (Adj1[u]==ant) {ant=u; u=Adj2[u];} else {ant=u; u=Adj1[u];}
-  }
-  Heuristic_2_OPT(tsp.AdjMat,tsp.BestCircuit,tsp.BestCircuitValue,tsp.NNodes);
+  tsp.BestTour.Set(Circuit);           // previous best circuit
+  Heuristic_LocalSearch(tsp,tsp.BestTour,tsp.BestCircuitValue);
   return(true);
 }
 
+// Separation of the subtour elimination constraints x(delta(S)) >= 2. The
+// buffers (including the contracted graph and its Gomory-Hu tree) are kept
+// between calls, since the separation is called at every node of the branch
+// and cut tree. The separation is done in three steps:
+// 1. If the support graph (edges with x[e]>0) is not connected, each
+//    connected component gives a violated cut. If it is connected and x is
+//    integer, x is a circuit and there is no violated cut.
+// 2. Padberg-Rinaldi shrinking: two (shrunk) nodes joined by edges of total
+//    value at least 1 are contracted, as a minimum cut can be chosen not to
+//    separate them. This contracts the paths of edges with x[e]==1.
+// 3. The Gomory-Hu tree of the shrunk graph gives the violated cuts.
+// The node set S of the i-th cut found is CutNodes[CutStart[i]..CutStart[i+1]-1]
+// (node indices of tsp).
+class SubtourSeparator {
+public:
+  SubtourSeparator(TSP_Data &tsp);
+  int Separate(const double *x,bool integer); // return the number of violated cuts
+  vector<int> CutStart,CutNodes;
+private:
+  TSP_Data &tsp;
+  int n,m;
+  vector<int> eu,ev;      // end nodes of the edges (node indices of tsp)
+  vector<int> Support;    // edges with x[e]>0
+  vector<int> UF,Root;    // union-find of the nodes and the root of each node
+  vector<pair<long long,double> > Pairs; // (pair of shrunk nodes, value of the edges)
+  vector<Node> Index2h;   // node of h of each root
+  vector<char> Side;      // side of each root in a cut
+  ListGraph h;            // shrunk support graph
+  EdgeValueMap h_capacity;
+  NodeBoolMap cutmap;
+  GomoryHu<ListGraph, EdgeValueMap> ght;
+  int Find(int v)
+  { while (UF[v]!=v) {UF[v]=UF[UF[v]]; v=UF[v];}  return(v); }
+  void AddCut(); // add the cut S={v: Side[Root[v]]}
+};
+
+SubtourSeparator::SubtourSeparator(TSP_Data &tsp):
+  tsp(tsp),
+  h_capacity(h),
+  cutmap(h),
+  ght(h,h_capacity)
+{
+  n = tsp.NNodes;  m = tsp.NEdges;
+  eu.resize(m);  ev.resize(m);
+  for (int k=0;k<m;k++) {
+    eu[k] = tsp.Node2Index[tsp.g.u(tsp.Index2Edge[k])];
+    ev[k] = tsp.Node2Index[tsp.g.v(tsp.Index2Edge[k])];
+  }
+  UF.resize(n);  Root.resize(n);  Index2h.resize(n);  Side.resize(n);
+}
+
+void SubtourSeparator::AddCut()
+{
+  for (int v=0;v<n;v++) if (Side[Root[v]]) CutNodes.push_back(v);
+  CutStart.push_back((int) CutNodes.size());
+}
+
+int SubtourSeparator::Separate(const double *x,bool integer)
+{
+  int k,v,ncomp=n;
+  bool merged;
+  CutStart.assign(1,0);  CutNodes.clear();  Support.clear();
+  for (v=0;v<n;v++) UF[v]=v;
+  for (k=0;k<m;k++)
+    if (x[k] > MY_EPS) {
+      Support.push_back(k);
+      int a=Find(eu[k]),b=Find(ev[k]);
+      if (a!=b) {UF[a]=b; ncomp--;}
+    }
+  for (v=0;v<n;v++) Root[v]=Find(v);
+  // Step 1: each connected component of the support graph is a violated cut
+  if (ncomp > 1) {
+    for (int c=0;c<n;c++) {
+      if (Root[c]!=c) continue;
+      for (v=0;v<n;v++) Side[v] = (v==c);
+      AddCut();
+      if (ncomp==2) break; // the two components give the same cut
+    }
+    return((int) CutStart.size()-1);
+  }
+  if (integer || (n<3)) return(0);
+
+  // Step 2: Padberg-Rinaldi shrinking, until no pair of shrunk nodes has value >= 1
+  for (v=0;v<n;v++) UF[v]=v;
+  ncomp = n;
+  do {
+    merged = false;
+    Pairs.clear();
+    for (unsigned i=0;i<Support.size();i++) {
+      int a=Find(eu[Support[i]]),b=Find(ev[Support[i]]);
+      if (a==b) continue;
+      if (a>b) swap(a,b);
+      Pairs.push_back(make_pair((long long) a*n+b,x[Support[i]]));
+    }
+    sort(Pairs.begin(),Pairs.end());
+    unsigned j=0; // aggregate the values of the edges between the same shrunk nodes
+    for (unsigned i=0;i<Pairs.size();i++) {
+      if (j>0 && Pairs[j-1].first==Pairs[i].first) Pairs[j-1].second += Pairs[i].second;
+      else Pairs[j++] = Pairs[i];
+    }
+    Pairs.resize(j);
+    for (unsigned i=0;(i<Pairs.size()) && (ncomp>2);i++) {
+      if (Pairs[i].second < 1.0-MY_EPS) continue;
+      int a=Find((int) (Pairs[i].first/n)),b=Find((int) (Pairs[i].first%n));
+      if (a!=b) {UF[a]=b; ncomp--; merged=true;}
+    }
+  } while (merged);
+  for (v=0;v<n;v++) Root[v]=Find(v);
+
+  // Step 3: Gomory-Hu tree of the shrunk graph (Pairs has its edges)
+  h.clear();
+  for (v=0;v<n;v++) if (Root[v]==v) Index2h[v]=h.addNode();
+  for (unsigned i=0;i<Pairs.size();i++) {
+    Edge a = h.addEdge(Index2h[(int) (Pairs[i].first/n)],Index2h[(int) (Pairs[i].first%n)]);
+    h_capacity[a] = Pairs[i].second;
+  }
+  ght.run();
+  // The Gomory-Hu tree is given as a rooted directed tree. Each node has
+  // an arc that points to its father. The root node has father -1.
+  // Remember that each arc in this tree represents a cut and the value of
+  // the arc is the weight of the corresponding cut. So, if an arc has weight
+  // less than 2, then we found a violated cut.
+  for (NodeIt u(h); u != INVALID; ++u) {
+    if (ght.predNode(u)==INVALID) continue; // skip the root node
+    if (ght.predValue(u) > 2.0 - MY_EPS) continue; // value of the cut is good
+    ght.minCutMap(u, ght.predNode(u), cutmap);  // now, we have a violated cut
+    for (v=0;v<n;v++) if (Root[v]==v) Side[v] = cutmap[Index2h[v]];
+    AddCut();
+  }
+  return((int) CutStart.size()-1);
+}
+
+// LP relaxation (degree and subtour constraints) solved before the branch and
+// cut, giving the lower bound LB and the duals used for reduced-cost fixing
+// and, in the sparse model, for pricing.
+// With the duals pi_v of the degree constraints and mu_S of the subtour cuts
+// (S is the smaller side of the cut), and alpha_v = pi_v + sum_{S: v in S} mu_S,
+// the reduced cost of an edge uv is
+//    rc_uv = c_uv - alpha_u - alpha_v + 2 sum_{S: u,v in S} mu_S >= c_uv - alpha_u - alpha_v.
+// When no edge has negative reduced cost (or it is at its upper bound), a
+// tour that uses an edge of reduced cost rc costs at least LB + rc. So, given
+// a tour of cost UB, the edges with LB + rc >= UB can be fixed to 0, as they
+// are not in any better tour.
+// Sparse model (large euclidean instances): there are variables only for the
+// edges of tsp.g (the core: Delaunay triangulation, nearest neighbours and
+// edges of the heuristic tour), and the other edges of the complete graph are
+// added by pricing. Only the points v at distance less than
+// alpha_u + max alpha + threshold of u can have reduced cost less than
+// threshold, so they are found by a range search over the points sorted by x
+// and the pricing does not look at all pairs of points.
+class TSP_RootLP {
+public:
+  TSP_RootLP(TSP_Data &tsp,GRBModel &model,ListGraph::EdgeMap<GRBVar> &x);
+  // Cutting planes (and pricing, in the sparse model), until the LP relaxation
+  // of the complete graph is solved. Return false if the LP could not be solved.
+  bool Solve();
+  // Add to the core the edges with reduced cost less than threshold (at most
+  // maxedges, the ones of smallest reduced cost), with variables of type vtype.
+  // The duals are the ones of the last LP solved. Return the number of edges added.
+  int Price(double threshold,int maxedges,char vtype);
+  // Reduced cost of the edge k of tsp, with the duals of the last LP solved
+  double ReducedCost(int k) const;
+  // Edges (not fixed yet) that are not in any tour of cost less than UB
+  void EliminatedEdges(double UB,vector<int> &Edges) const;
+  // Fix to 0 the variables of the edges eliminated by UB. Return the number of edges fixed.
+  int FixEdges(double UB);
+  bool IsFixed(int k) const { return((k < (int) Fixed.size()) && Fixed[k]); }
+  double LowerBound; // value of the LP relaxation of the complete graph
+private:
+  TSP_Data &tsp;
+  GRBModel &model;
+  ListGraph::EdgeMap<GRBVar> &x;
+  int n;
+  vector<GRBConstr> Degree,CutRow;
+  vector<vector<int> > NodeCuts; // cuts (increasing order) whose smaller side contains each node
+  vector<double> Alpha,Mu;
+  double AlphaMax;
+  vector<int> ByX;    // nodes sorted by the x coordinate (sparse model)
+  vector<char> InS;
+  vector<char> Fixed; // edges fixed to 0
+  void AddVar(int k,char vtype); // variable of the edge k of tsp, in the degree and cut rows
+  void AddCut(const int *S,int size);
+  void ReadDuals();
+  double CommonMu(int u,int v) const; // sum of mu_S over the cuts with u,v in S
+};
+
+TSP_RootLP::TSP_RootLP(TSP_Data &tsp,GRBModel &model,ListGraph::EdgeMap<GRBVar> &x):
+  tsp(tsp), model(model), x(x)
+{
+  char name[1000];
+  n = tsp.NNodes;
+  NodeCuts.resize(n);  InS.resize(n);
+  if (tsp.Costs.E) {
+    const EuclideanGraph &E=*tsp.Costs.E;
+    ByX.resize(n);
+    for (int v=0;v<n;v++) ByX[v]=v;
+    sort(ByX.begin(),ByX.end(),[&E](int a,int b) {return(E.posx[a]<E.posx[b]);});
+  }
+  for (int k=0;k<tsp.NEdges;k++) {
+    Edge e=tsp.Index2Edge[k];
+    sprintf(name,"x_%s_%s",tsp.vname[tsp.g.u(e)].c_str(),tsp.vname[tsp.g.v(e)].c_str());
+    x[e] = model.addVar(0.0, 1.0, tsp.weight[e],GRB_CONTINUOUS,name);
+  }
+  model.update();
+  for (int v=0;v<n;v++) {
+    GRBLinExpr expr;
+    for (IncEdgeIt e(tsp.g,tsp.Index2Node[v]); e!=INVALID; ++e) expr += x[e];
+    Degree.push_back(model.addConstr(expr == 2 ));
+  }
+  LowerBound = 0.0;
+}
+
+void TSP_RootLP::AddVar(int k,char vtype)
+{
+  Edge e=tsp.Index2Edge[k];
+  int u=tsp.Node2Index[tsp.g.u(e)],v=tsp.Node2Index[tsp.g.v(e)];
+  char name[1000];
+  GRBColumn col;
+  col.addTerm(1.0,Degree[u]);  col.addTerm(1.0,Degree[v]);
+  // the cuts crossed by uv are the ones in exactly one of NodeCuts[u] and NodeCuts[v]
+  vector<int>::const_iterator a=NodeCuts[u].begin(),b=NodeCuts[v].begin();
+  while ((a!=NodeCuts[u].end()) || (b!=NodeCuts[v].end())) {
+    if ((b==NodeCuts[v].end()) || ((a!=NodeCuts[u].end()) && (*a<*b))) col.addTerm(1.0,CutRow[*a++]);
+    else if ((a==NodeCuts[u].end()) || (*b<*a)) col.addTerm(1.0,CutRow[*b++]);
+    else {a++; b++;}
+  }
+  sprintf(name,"x_%s_%s",tsp.vname[tsp.g.u(e)].c_str(),tsp.vname[tsp.g.v(e)].c_str());
+  x[e] = model.addVar(0.0, 1.0, tsp.weight[e],vtype,col,name);
+}
+
+void TSP_RootLP::AddCut(const int *S,int size)
+{
+  int c=(int) CutRow.size();
+  bool complement=(2*size > n);
+  GRBLinExpr expr;
+  for (int v=0;v<n;v++) InS[v]=complement;
+  for (int i=0;i<size;i++) InS[S[i]]=!complement;
+  for (int v=0;v<n;v++) if (InS[v]) NodeCuts[v].push_back(c);
+  for (int k=0;k<tsp.NEdges;k++) {
+    Edge e=tsp.Index2Edge[k];
+    if (InS[tsp.Node2Index[tsp.g.u(e)]]!=InS[tsp.Node2Index[tsp.g.v(e)]]) expr += x[e];
+  }
+  CutRow.push_back(model.addConstr(expr >= 2 ));
+}
+
+void TSP_RootLP::ReadDuals()
+{
+  Mu.resize(CutRow.size());
+  for (unsigned c=0;c<CutRow.size();c++) Mu[c] = max(0.0,CutRow[c].get(GRB_DoubleAttr_Pi));
+  Alpha.resize(n);
+  AlphaMax = -DBL_MAX;
+  for (int v=0;v<n;v++) {
+    Alpha[v] = Degree[v].get(GRB_DoubleAttr_Pi);
+    for (unsigned i=0;i<NodeCuts[v].size();i++) Alpha[v] += Mu[NodeCuts[v][i]];
+    AlphaMax = max(AlphaMax,Alpha[v]);
+  }
+}
+
+double TSP_RootLP::CommonMu(int u,int v) const
+{
+  double sum=0.0;
+  vector<int>::const_iterator a=NodeCuts[u].begin(),b=NodeCuts[v].begin();
+  while ((a!=NodeCuts[u].end()) && (b!=NodeCuts[v].end())) {
+    if (*a<*b) a++;
+    else if (*b<*a) b++;
+    else {sum += Mu[*a]; a++; b++;}
+  }
+  return(sum);
+}
+
+int TSP_RootLP::Price(double threshold,int maxedges,char vtype)
+{
+  const EuclideanGraph &E=*tsp.Costs.E;
+  vector<pair<double,pair<int,int> > > Found; // (reduced cost, edge)
+  for (int u=0;u<n;u++) {
+    double R=Alpha[u]+AlphaMax+threshold;
+    if (R <= 0) continue;
+    int i = (int) (lower_bound(ByX.begin(),ByX.end(),E.posx[u]-R,
+			       [&E](int a,double px) {return(E.posx[a]<px);})-ByX.begin());
+    for (;(i<n) && (E.posx[ByX[i]] <= E.posx[u]+R);i++) {
+      int v=ByX[i];
+      if ((v<=u) || (fabs(E.posy[v]-E.posy[u]) > R) || tsp.HasEdge(u,v)) continue;
+      double rc = E.Cost(u,v)-Alpha[u]-Alpha[v];
+      if (rc >= threshold-MY_EPS) continue;
+      rc += 2*CommonMu(u,v);
+      if (rc < threshold-MY_EPS) Found.push_back(make_pair(rc,make_pair(u,v)));
+    }
+  }
+  if ((int) Found.size() > maxedges) {
+    nth_element(Found.begin(),Found.begin()+maxedges,Found.end());
+    Found.resize(maxedges);
+  }
+  for (unsigned i=0;i<Found.size();i++)
+    AddVar(tsp.AddEdge(Found[i].second.first,Found[i].second.second),vtype);
+  return((int) Found.size());
+}
+
+double TSP_RootLP::ReducedCost(int k) const
+{
+  Edge e=tsp.Index2Edge[k];
+  int u=tsp.Node2Index[tsp.g.u(e)],v=tsp.Node2Index[tsp.g.v(e)];
+  return(tsp.weight[e]-Alpha[u]-Alpha[v]+2*CommonMu(u,v));
+}
+
+void TSP_RootLP::EliminatedEdges(double UB,vector<int> &Edges) const
+{
+  Edges.clear();
+  for (int k=0;k<tsp.NEdges;k++)
+    if (!IsFixed(k) && (LowerBound+ReducedCost(k) >= UB-MY_EPS)) Edges.push_back(k);
+}
+
+int TSP_RootLP::FixEdges(double UB)
+{
+  vector<int> Edges;
+  EliminatedEdges(UB,Edges);
+  Fixed.resize(tsp.NEdges,0);
+  for (unsigned i=0;i<Edges.size();i++) {
+    Fixed[Edges[i]] = 1;
+    x[tsp.Index2Edge[Edges[i]]].set(GRB_DoubleAttr_UB,0.0);
+  }
+  return((int) Edges.size());
+}
+
+bool TSP_RootLP::Solve()
+{
+  vector<double> xval;
+  for (int round=1;;round++) {
+    model.optimize();
+    if (model.get(GRB_IntAttr_Status)!=GRB_OPTIMAL) return(false);
+    xval.resize(tsp.NEdges);
+    for (int k=0;k<tsp.NEdges;k++) xval[k] = x[tsp.Index2Edge[k]].get(GRB_DoubleAttr_X);
+    SubtourSeparator sep(tsp); // built again, as the pricing changes the edges
+    int ncuts = sep.Separate(&xval[0],false),nedges=0;
+    for (int i=0;i<ncuts;i++)
+      AddCut(&sep.CutNodes[sep.CutStart[i]],sep.CutStart[i+1]-sep.CutStart[i]);
+    if (ncuts==0) { // price only the LP with all violated cuts
+      ReadDuals();
+      if (tsp.Costs.E) nedges = Price(0.0,n,GRB_CONTINUOUS);
+    }
+    printf("[Root LP] Round %d: value %.2f, %d edges, %d new cuts, %d new edges\n",
+	   round,model.get(GRB_DoubleAttr_ObjVal),tsp.NEdges-nedges,ncuts,nedges);
+    if (ncuts+nedges==0) {
+      LowerBound = model.get(GRB_DoubleAttr_ObjVal);
+      return(true);
+    }
+    model.update();
+  }
+}
+
+// Separation of the subtour cuts in the branch and cut. If the root LP is
+// given, the edges fixed to 0 by it are not read, and when a better tour is
+// found the edges eliminated by its cost are fixed to 0 by a lazy constraint.
 class subtourelim: public GRBCallback
 { TSP_Data &tsp;
   ListGraph::EdgeMap<GRBVar>& x;
-  double (GRBCallback::*solution_value)(GRBVar);
+  TSP_RootLP *lp;
+  vector<int> Free;     // edges not fixed to 0 (indices of tsp.Index2Edge)
+  vector<GRBVar> xvars; // variables of the edges in Free
+  vector<double> xfull; // values of the variables of all edges of tsp.Index2Edge
+  vector<GRBVar> xid;   // variables indexed by the edge ids
+  vector<double> xidval; // values of the variables indexed by the edge ids
+  vector<int> EdgeId;   // id of each edge of tsp.Index2Edge
+  vector<int> Cuts,S;
+  vector<int> Eliminated; // edges eliminated by the incumbent (not fixed at the root)
+  double FixingUB;      // cost of the tour used in the last reduced-cost fixing
+  SubtourSeparator sep;
 public:
-  subtourelim(TSP_Data &tsp, ListGraph::EdgeMap<GRBVar>& x) : tsp(tsp),x(x)  {    }
+  CutPool Pool; // subtour cuts already added
+  int NFixed;   // edges fixed to 0 during the branch and cut
+  subtourelim(TSP_Data &tsp, ListGraph::EdgeMap<GRBVar>& x, TSP_RootLP *lp=NULL) :
+    tsp(tsp),x(x),lp(lp),sep(tsp),Pool(tsp.g),NFixed(0)
+  { xid.resize(tsp.g.maxEdgeId()+1);  xidval.assign(tsp.g.maxEdgeId()+1,0.0);
+    xfull.assign(tsp.NEdges,0.0);
+    FixingUB = tsp.BestCircuitValue;
+    for (int k=0;k<tsp.NEdges;k++) {
+      Edge e=tsp.Index2Edge[k];
+      EdgeId.push_back(tsp.g.id(e));  xid[tsp.g.id(e)] = x[e];
+      if (lp && lp->IsFixed(k)) continue;
+      Free.push_back(k);  xvars.push_back(x[e]);
+    }
+  }
 protected:
   void callback()
   { // --------------------------------------------------------------------------------
-    // get the correct function to obtain the values of the lp variables
+    // get the values of the lp variables
+    double *xval;
+    bool integer;
+    int nfree=(int) Free.size();
     if  (where==GRB_CB_MIPSOL) // if this condition is true, all variables are integer
-      {solution_value = &subtourelim::getSolution;}
+      {xval = getSolution(&xvars[0],nfree); integer=true;}
     else if ((where==GRB_CB_MIPNODE) &&  
       (getIntInfo(GRB_CB_MIPNODE_STATUS)==GRB_OPTIMAL))// node with optimal fractional solution
-      {solution_value = &subtourelim::getNodeRel;}
+      {xval = getNodeRel(&xvars[0],nfree); integer=false;}
     else return; // return, as this code do not take advantage of the other options
     // --------------------------------------------------------------------------------
-    // Stores the edges with fractional values and integer values
-    vector<Edge> FracEdges,OneEdges;
-    // produces a subgraph h of g, with edges e with x[e]==1 
-    // contracted, so we can apply Gomory-Hu tree in a small graph
-    ListGraph::EdgeMap<bool> one_filter(tsp.g, false); // start without any edge
-    ListGraph::EdgeMap<bool> non_zero_filter(tsp.g, false); // start without any edge
-    for (EdgeIt e(tsp.g); e != INVALID; ++e) {
-      if ((this->*solution_value)(x[e]) > 1-MY_EPS)
-	OneEdges.push_back(e); // stores the edges with x[e]==1
-      else if ((this->*solution_value)(x[e]) > MY_EPS)
-	FracEdges.push_back(e); // includes edges with 0 < x[e] < 1
-    }// define the subgraph with edges that have x[e]==1
-
+    Pool.StartCallback();
     try {
-      // --------------------------------------------------------------------------------
-      // Use union-find to contract nodes (to obtain graph where each componente of g is contracted)
-      //for (int i=0;i<tsp.NNodes;i++) UFIndexToNode[i]=INVALID;
-      ListGraph::NodeMap<int> aux_map(tsp.g);
-      UnionFind<ListGraph::NodeMap<int> > UFNodes(aux_map);
-      for (NodeIt v(tsp.g); v!=INVALID; ++v) UFNodes.insert(v);
-      for (vector<Edge>::iterator e_it=OneEdges.begin(); e_it != OneEdges.end(); ++e_it)
-	UFNodes.join(tsp.g.u(*e_it),tsp.g.v(*e_it));// No problem if they are in a same component
-      // --------------------------------------------------------------------------------
-      // Put in a separate set all edges that are not inside a component 
-      vector<Edge> CrossingEdges;
-      for (EdgeIt e(tsp.g); e != INVALID; ++e) 
-	if (UFNodes.find(tsp.g.u(e)) != UFNodes.find(tsp.g.v(e)))
-	  CrossingEdges.push_back(e);
-      // --------------------------------------------------------------------------------
-      // Generate an inverted list UFIndexToNode to find the node that represents a component
-      vector<bool> ComponentIndex(tsp.NNodes);
-      vector<Node> Index2h(tsp.NNodes);
-      for(int i=0;i<tsp.NNodes;i++) ComponentIndex[i]=false;
-      for (NodeIt v(tsp.g); v!=INVALID; ++v) ComponentIndex[UFNodes.find(v)]=true;
-      // --------------------------------------------------------------------------------
-      // Generate graph of components, add one node for each component and edges
-      ListGraph h;
-      EdgeValueMap h_capacity(h); 
-      for(int i=0;i<tsp.NNodes;i++)  // add nodes to the graph h
-	if (ComponentIndex[i]) Index2h[i]=h.addNode(); 
-      for (vector<Edge>::iterator e_it=FracEdges.begin(); e_it != FracEdges.end(); ++e_it){
-	Node  u = tsp.g.u(*e_it),              v = tsp.g.v(*e_it),
-	     hu = Index2h[UFNodes.find(u)],   hv = Index2h[UFNodes.find(v)];
-	Edge a = h.addEdge(hu , hv );         // add edges to the graph h
-	h_capacity[a] = (this->*solution_value)(x[*e_it]);
+      if (lp && (where==GRB_CB_MIPNODE)) FixByIncumbent(getDoubleInfo(GRB_CB_MIPNODE_OBJBST));
+      // First look for violated cuts in the pool, and separate new cuts only if there is none
+      for (int i=0;i<nfree;i++) {
+	xfull[Free[i]] = xval[i];  xidval[EdgeId[Free[i]]] = xval[i];
       }
-      // --------------------------------------------------------------------------------
-      GomoryHu<ListGraph, EdgeValueMap> ght(h, h_capacity);   ght.run();
-      // The Gomory-Hu tree is given as a rooted directed tree. Each node has
-      // an arc that points to its father. The root node has father -1.
-      // Remember that each arc in this tree represents a cut and the value of
-      // the arc is the weight of the corresponding cut. So, if an arc has weight
-      // less than 2, then we found a violated cut and in this case, we insert the
-      // corresponding constraint.
-
-      NodeBoolMap cutmap(h);
-      for (NodeIt u(h); u != INVALID; ++u) {
-	GRBLinExpr expr = 0;
-	if (ght.predNode(u)==INVALID) continue; // skip the root node
-	if (ght.predValue(u) > 2.0 - MY_EPS) continue; // value of the cut is good
-	ght.minCutMap(u, ght.predNode(u), cutmap);  // now, we have a violated cut
-
-	// Percorre as arestas que cruzam alguma componente e insere as que pertencem ao corte
-	for (vector<Edge>::iterator e_it=CrossingEdges.begin();e_it!=CrossingEdges.end();++e_it){
-	  Node u=tsp.g.u(*e_it), v=tsp.g.v(*e_it),
-	    hu = Index2h[UFNodes.find(u)], hv=Index2h[UFNodes.find(v)];
-	  if (cutmap[hu] != cutmap[hv])
-	    expr += x[*e_it];
+      Cuts.clear();
+      if (!Pool.FindViolated(&xidval[0],Cuts)) {
+	int ncuts = sep.Separate(&xfull[0],integer);
+	for (int i=0;i<ncuts;i++) {
+	  S.clear();
+	  for (int j=sep.CutStart[i];j<sep.CutStart[i+1];j++)
+	    S.push_back(tsp.g.id(tsp.Index2Node[sep.CutNodes[j]]));
+	  int c = Pool.Add(S,2.0);
+	  if (c>=0) Cuts.push_back(c);
 	}
+      }
+      for (unsigned i=0;i<Cuts.size();i++) {
+	GRBLinExpr expr = 0;
+	const int *e=Pool.Edges(Cuts[i]);
+	for (int j=0;j<Pool.NEdges(Cuts[i]);j++) expr += xid[e[j]];
 	addLazy( expr >= 2 );
       }
-
-
     } catch (...) {
       cout << "Error during callback..." << endl;
     }
+    Pool.EndCallback();
+    delete[] xval;
+  }
+  // The incumbent improved: fix to 0 (by a lazy constraint, as the bounds can
+  // not be changed during the optimization) the edges that it eliminates.
+  void FixByIncumbent(double UB)
+  {
+    if (UB >= FixingUB-MY_EPS) return;
+    FixingUB = UB;
+    lp->EliminatedEdges(UB,Eliminated);
+    int nfixed=(int) Eliminated.size();
+    if (nfixed <= NFixed) return; // the same edges of the last fixing
+    GRBLinExpr expr = 0;
+    for (int i=0;i<nfixed;i++) expr += x[tsp.Index2Edge[Eliminated[i]]];
+    addLazy( expr <= 0 );
+    printf("[Reduced-cost fixing] Tour of cost %.2f: %d more edges fixed to 0\n",UB,nfixed-NFixed);
+    NFixed = nfixed;
   }
 };
 
 
-void ChangeNode(Node &a,Node &b)
-{ Node c;  c = a; a = b; b = c; }
-  
-// This routine starts with some solution (current best or a random generated
-// solution) and iteratively perturb changing some nodes and applying 2OPT.
-bool TSP_Perturb2OPT(TSP_Data &tsp)
+// Double bridge kick: the tour A B C D becomes A C B D, where B and C are
+// random short segments (at most DOUBLEBRIDGE_MAXSEG nodes), so the change
+// is local and only the nodes at the ends of the segments are added to Active.
+// B C is reversed and then B and C are reversed back. Return the increase
+// of the cost of the tour. The random numbers are taken from the erand48
+// stream Rand, so each thread can have its own.
+double DoubleBridgeKick(TSP_Costs &A,TSPTour &T,vector<int> &Active,
+			unsigned short Rand[3])
 {
-  ListGraph *g;
-  int nchanges,i,j;
-  g = &tsp.g;
-  vector<Node> Circuit(tsp.NNodes), BestCircuit(tsp.NNodes);
-  double BestCircuitValue;
-  //nchanges = 2 (tests with some instances indicate that nchanges=1 is better
-  nchanges = 1;
+  int n=T.Nnodes(),maxseg=min(DOUBLEBRIDGE_MAXSEG,(n-2)/2),k;
+  if (maxseg<1) return(0.0);
+  int a=(int) (erand48(Rand)*n),
+    L1=1+(int) (erand48(Rand)*maxseg),
+    L2=1+(int) (erand48(Rand)*maxseg),
+    b1=T.Next(a),b2=b1,c1,c2,d;
+  for (k=1;k<L1;k++) b2=T.Next(b2);
+  c1=c2=T.Next(b2);
+  for (k=1;k<L2;k++) c2=T.Next(c2);
+  d=T.Next(c2);
+  T.Reverse(b1,c2);  // a c2..c1 b2..b1 d
+  T.Reverse(c2,c1);  // a c1..c2 b2..b1 d
+  T.Reverse(b2,b1);  // a c1..c2 b1..b2 d
+  int ends[6]={a,b1,b2,c1,c2,d};
+  Active.insert(Active.end(),ends,ends+6);
+  return(A.Cost(a,c1)+A.Cost(c2,b1)+A.Cost(b2,d)-A.Cost(a,b1)-A.Cost(b2,c1)-A.Cost(c2,d));
+}
 
-  // Start with a initial solution (if there is no solution, generate any sequence)
-  if (tsp.BestCircuitValue < DBL_MAX) {
-    BestCircuitValue = tsp.BestCircuitValue;
-    for (int i=0; i<tsp.NNodes; i++) BestCircuit[i] = tsp.BestCircuit[i];
-  } else {
-    int i=0;
-    BestCircuitValue = 0.0;
-    for (NodeIt v(*g); v!=INVALID; ++v) BestCircuit[i++]=v;
-    for (i=0;i<tsp.NNodes;i++) 
-      BestCircuitValue += 
-	tsp.AdjMat.Cost(BestCircuit[i] , BestCircuit[(i+1)%tsp.NNodes]);
-  }
-
-  for (int it=0;it<tsp.max_perturb2opt_it;it++) {
-    if (!(it%100)) printf("[Heuristic: Perturbation+2OPT] it = %d (of %d)\n",it+1,tsp.max_perturb2opt_it);
-    for (int k=0;k<tsp.NNodes;k++) Circuit[k] = BestCircuit[k];
-    for (int nc=0;nc<nchanges;nc++) {
-      i = (int) (drand48()*tsp.NNodes);  // get two random nodes and exchange
-      j = (int) (drand48()*tsp.NNodes);  // their positions
-      if (i!=j) ChangeNode(Circuit[i],Circuit[j]);
-    }
-    Heuristic_2_OPT(tsp.AdjMat,Circuit,BestCircuitValue,tsp.NNodes);
-    if (BestCircuitValue < tsp.BestCircuitValue) { //update the best circuit used
-      tsp.BestCircuitValue = BestCircuitValue;     // by the heuristic
-      for (int i=0;i<tsp.NNodes;i++) {
-	BestCircuit[i] = Circuit[i];
-	tsp.BestCircuit[i] = Circuit[i];
-      }
+// One thread of the iterated local search: starts with the tour Start, of
+// value StartValue, and iteratively applies a double bridge kick and the local
+// search (Lin-Kernighan style and Or-opt moves) to its best tour. The random
+// numbers come from the erand48 stream of Seed and Id (for Id=0 it is the same
+// stream of srand48(Seed)); Id is mixed in the seed by a large odd factor, so
+// the threads of nearby seeds do not share their streams. Each improvement is stored in tsp.BestTour, under
+// tsp.BestTourLock; ties are decided by the smallest Id (in BestId), so the
+// final tour does not depend on the scheduling of the threads.
+void TSP_ILSThread(TSP_Data &tsp,TSPTour &Start,double StartValue,
+		   int Id,int Iterations,int Seed,int &BestId)
+{
+  TSP_Costs &A=tsp.Costs;
+  TSPTour Tour,BestTour=Start;
+  vector<int> Active;
+  double BestCircuitValue=StartValue,Value;
+  unsigned int s=(unsigned int) Seed+0x9E3779B9u*(unsigned int) Id;
+  unsigned short Rand[3]={0x330E,(unsigned short) (s&0xFFFF),(unsigned short) (s>>16)};
+
+  for (int it=0;it<Iterations;it++) {
+    Tour = BestTour;  Active.clear();
+    Value = BestCircuitValue+DoubleBridgeKick(A,Tour,Active,Rand);
+    Value -= TSP_LocalSearch(A,tsp.Candidates,tsp.NCandidates,Tour,Active);
+    if ((Value >= BestCircuitValue-MY_EPS) ||
+	((Value=TourCost(A,Tour)) >= BestCircuitValue-MY_EPS)) continue; // exact value of the new tour
+    BestCircuitValue = Value;  BestTour = Tour;
+    tsp.BestTourLock.lock();
+    if ((BestCircuitValue < tsp.BestCircuitValue-MY_EPS) || //update the best circuit used
+	((BestCircuitValue < tsp.BestCircuitValue+MY_EPS) && (Id < BestId))) { // by the heuristic
+      if (BestCircuitValue < tsp.BestCircuitValue-MY_EPS)
+	cout << "[Heuristic: LocalSearch] New Solution of value " << BestCircuitValue << "\n";
+      tsp.BestCircuitValue = BestCircuitValue;
+      tsp.BestTour = BestTour;  BestId = Id;
     }
+    tsp.BestTourLock.unlock();
   }
+}
+
+// Iterated local search: starts with some solution (current best or any
+// sequence of the nodes) improved by the local search. Then the tsp.max_ils_it
+// iterations are split among tsp.NThreads threads, all of them starting from
+// this tour, each one with its own random stream (derived from Seed). The
+// threads share only the best tour found (tsp.BestTour).
+bool TSP_IteratedLocalSearch(TSP_Data &tsp,int Seed)
+{
+  TSP_Costs &A=tsp.Costs;
+  int n=tsp.NNodes,NThreads=max(1,min(tsp.NThreads,tsp.max_ils_it)),BestId=NThreads;
+  TSPTour Start;
+  vector<int> Active(n);
+  vector<thread> Threads;
+  double StartValue;
+
+  // Start with a initial solution (if there is no solution, generate any sequence)
+  if (tsp.BestCircuitValue < DBL_MAX) Start = tsp.BestTour;
+  else {
+    for (int i=0;i<n;i++) Active[i]=i;
+    Start.Set(Active);
+  }
+  Start.Sequence(Active);
+  TSP_LocalSearch(A,tsp.Candidates,tsp.NCandidates,Start,Active);
+  StartValue = TourCost(A,Start);
+  if (StartValue < tsp.BestCircuitValue-MY_EPS) {
+    tsp.BestCircuitValue = StartValue;  tsp.BestTour = Start;
+    cout << "[Heuristic: LocalSearch] New Solution of value " << StartValue << "\n";
+  }
+
+  printf("[Heuristic: Iterated Local Search] %d iterations in %d threads\n",tsp.max_ils_it,NThreads);
+  for (int t=1;t<NThreads;t++)
+    Threads.push_back(thread(TSP_ILSThread,ref(tsp),ref(Start),StartValue,t,
+			     tsp.max_ils_it/NThreads+(t<tsp.max_ils_it%NThreads),Seed,ref(BestId)));
+  TSP_ILSThread(tsp,Start,StartValue,0,tsp.max_ils_it/NThreads+(0<tsp.max_ils_it%NThreads),Seed,BestId);
+  for (unsigned t=0;t<Threads.size();t++) Threads[t].join();
   return(true);
 }
 
@@ -372,11 +996,11 @@ void ViewTspCircuit(TSP_Data &tsp)
     h_vname[hv] = tsp.vname[v];
     vcolor[hv] = GRAY;
   }
-  for (int i=0;i<tsp.NNodes;i++) {
+  for (int i=0,k=0;i<tsp.NNodes;i++,k=tsp.BestTour.Next(k)) {
     Node u,v;
     Edge a;
-    u = tsp.BestCircuit[i]; 
-    v = tsp.BestCircuit[(i+1) % tsp.NNodes]; 
+    u = tsp.Index2Node[k]; 
+    v = tsp.Index2Node[tsp.BestTour.Next(k)]; 
     a = h.addEdge(g2h[u] , g2h[v]);
     aname[a] = "";
     acolor[a] = BLUE;
@@ -385,10 +1009,91 @@ void ViewTspCircuit(TSP_Data &tsp)
 }
 
 
+// Solve the TSP of an euclidean graph (file with only the points) with the
+// sparse model. The core starts with the Delaunay triangulation, the
+// TSP_SPARSE_KNN nearest neighbours of each node and the edges of the heuristic
+// tour; it grows by pricing the LP and then the edges that could improve the
+// optimum of the core are added (reduced cost less than the gap between this
+// optimum and the LP bound), until there is none. So, the optimality is proved
+// for the complete graph, although the model has O(n) variables.
+int TSP_SparseMain(string filename,int time_limit,int seed)
+{
+  EuclideanGraph eg;
+  ListGraph g;
+  EdgeValueMap weight(g);
+  NodeStringMap vname(g);
+  NodePosMap   posx(g),posy(g);
+  vector<Node> Index2Node;
+  vector<pair<int,int> > Delaunay;
+
+  if (!ReadEuclideanGraph(filename,eg))
+    {cout<<"Error reading euclidean graph file "<<filename<<"."<<endl;exit(0);}
+  eg.BuildCandidates(TSP_SPARSE_KNN);
+  eg.BuildListGraph(g,vname,weight,posx,posy,Index2Node,true);
+  TSP_Data tsp(g,vname,posx,posy,weight,eg,Index2Node);
+  if (!eg.DelaunayEdges(Delaunay)) cout << "Delaunay triangulation failed, using only the nearest neighbours" << endl;
+  for (unsigned i=0;i<Delaunay.size();i++) tsp.AddEdge(Delaunay[i].first,Delaunay[i].second);
+
+  tsp.max_ils_it = 2000; // number of iterations used in heuristic TSP_IteratedLocalSearch
+  TSP_IteratedLocalSearch(tsp,seed);
+  for (int i=0;i<tsp.NNodes;i++) tsp.AddEdge(i,tsp.BestTour.Next(i));
+  cout << "Sparse model with " << tsp.NEdges << " edges (" << Delaunay.size()
+       << " from the Delaunay triangulation)" << endl;
+
+  ListGraph::EdgeMap<GRBVar> x(g);
+  GRBEnv env = GRBEnv();
+  GRBModel model = GRBModel(env);
+#if GUROBI_NEWVERSION
+  model.getEnv().set(GRB_IntParam_Seed, seed);
+#endif
+  model.set(GRB_StringAttr_ModelName, "Undirected TSP with GUROBI (sparse model)");
+  model.set(GRB_IntAttr_ModelSense, GRB_MINIMIZE);
+  if (time_limit >= 0) model.getEnv().set(GRB_DoubleParam_TimeLimit,time_limit);
+
+  try {
+    TSP_RootLP lp(tsp,model,x);
+    if (!lp.Solve()) {cout << "Could not solve the LP relaxation" << endl; return 1;}
+    cout << "Lower bound (LP of the complete graph) = " << lp.LowerBound
+	 << ", core with " << tsp.NEdges << " edges" << endl;
+
+    for (int k=0;k<tsp.NEdges;k++) x[tsp.Index2Edge[k]].set(GRB_CharAttr_VType,GRB_BINARY);
+#if GUROBI_NEWVERSION
+    model.getEnv().set(GRB_IntParam_LazyConstraints, 1);
+#else
+    model.getEnv().set(GRB_IntParam_DualReductions, 0); // Dual reductions must be disabled when using lazy constraints
+#endif
+    for (;;) {
+      printf("[Reduced-cost fixing] %d edges fixed to 0\n",lp.FixEdges(tsp.BestCircuitValue));
+      model.getEnv().set(GRB_DoubleParam_Cutoff, tsp.BestCircuitValue-MY_EPS);
+      model.update();
+      subtourelim cb(tsp , x, &lp); // built after the core changes
+      model.setCallback(&cb);
+      model.optimize();
+      if (model.get(GRB_IntAttr_SolCount) > 0) Update_Circuit(tsp,x);
+      cb.Pool.PrintStatistics("Subtour cuts");
+      if (model.get(GRB_IntAttr_Status)==GRB_TIME_LIMIT) {
+	cout << "Time limit: the optimality of the circuit was not proved" << endl;
+	break;
+      }
+      // optimum of the core; only edges with reduced cost < gap can improve it
+      int nedges = lp.Price(tsp.BestCircuitValue-lp.LowerBound,INT_MAX,GRB_BINARY);
+      if (nedges==0) break;
+      cout << "Adding " << nedges << " edges with reduced cost less than the gap "
+	   << tsp.BestCircuitValue-lp.LowerBound << endl;
+    }
+    model.setCallback(NULL);
+    cout << "Solution cost = "<< tsp.BestCircuitValue << endl;
+    ViewTspCircuit(tsp);
+  } catch (GRBException e) {
+    cout << "Error code = " << e.getErrorCode() << endl << e.getMessage() << endl;
+    return 1;
+  }
+  return 0;
+}
+
 int main(int argc, char *argv[]) 
 {
   int time_limit;
-  char name[1000];
   double cutoff=0.0;
   ListGraph g;
   EdgeValueMap weight(g);
@@ -406,12 +1111,17 @@ int main(int argc, char *argv[])
 
   srand48(seed);
   time_limit = 3600; // solution must be obtained within time_limit seconds
-  if (argc!=2) {cout<< endl << "Usage: "<< argv[0]<<" <graph_filename>"<<endl << endl <<
+  if ((argc<2) || (argc>3) || ((argc==3) && (string(argv[2])!="-sparse"))) {
+    cout<< endl << "Usage: "<< argv[0]<<" <graph_filename> [-sparse]"<<endl << endl <<
+      "  -sparse: sparse model for an euclidean graph file (<number_of_nodes> -1),"<<endl<<
+      "           with edges added by pricing" << endl << endl <<
       "Example: " << argv[0] << " gr_berlin52" << endl <<
-      "         " << argv[0] << " gr_att48" << endl << endl; exit(0);}
+      "         " << argv[0] << " gr_att48" << endl <<
+      "         " << argv[0] << " gr_eucli_100 -sparse" << endl << endl; exit(0);}
   
   else if (!FileExists(argv[1])) {cout<<"File "<<argv[1]<<" does not exist."<<endl; exit(0);}
   filename = argv[1];
+  if (argc==3) return(TSP_SparseMain(filename,time_limit,seed));
   
   // Read the graph
   if (!ReadListGraph(filename,g,vname,weight,posx,posy)) 
@@ -430,31 +1140,31 @@ int main(int argc, char *argv[])
   model.set(GRB_StringAttr_ModelName, "Undirected TSP with GUROBI"); // name to the problem
   model.set(GRB_IntAttr_ModelSense, GRB_MINIMIZE); // is a minimization problem
   
-  // Add one binary variable for each edge and also sets its cost in the objective function
-  for (EdgeIt e(g); e!=INVALID; ++e) {
-    sprintf(name,"x_%s_%s",vname[g.u(e)].c_str(),vname[g.v(e)].c_str());
-    x[e] = model.addVar(0.0, 1.0, weight[e],GRB_BINARY,name);
-  }
-  model.update(); // run update to use model inserted variables
-
-  // Add degree constraint for each node (sum of solution edges incident to a node is 2)
-  for (NodeIt v(g); v!=INVALID; ++v) {
-    GRBLinExpr expr;
-    for (IncEdgeIt e(g,v); e!=INVALID; ++e) expr += x[e];
-    model.addConstr(expr == 2 );
-  }
-
   try {
-    model.update(); // Process any pending model modifications.
     if (time_limit >= 0) model.getEnv().set(GRB_DoubleParam_TimeLimit,time_limit);
 
-    subtourelim cb = subtourelim(tsp , x);
-    model.setCallback(&cb);
-    
-    tsp.max_perturb2opt_it = 200; //1000; // number of iterations used in heuristic TSP_Perturb2OPT
-    TSP_Perturb2OPT(tsp);
+    tsp.max_ils_it = 2000; // number of iterations used in heuristic TSP_IteratedLocalSearch
+    TSP_IteratedLocalSearch(tsp,seed);
     if (tsp.BestCircuitValue < DBL_MAX) cutoff = tsp.BestCircuitValue-MY_EPS; // 
     // optimum value for gr_a280=2579, gr_xqf131=566.422, gr_drilling198=15780
+
+    // One variable for each edge, with its cost in the objective function, and
+    // the degree constraints (sum of solution edges incident to a node is 2).
+    // The root LP (with the subtour cuts) gives the reduced costs used to fix
+    // to 0 the edges that are not in any tour better than the heuristic one.
+    TSP_RootLP lp(tsp,model,x),*rootlp=NULL;
+    if (lp.Solve()) {
+      rootlp = &lp;
+      cout << "Lower bound (root LP) = " << lp.LowerBound << endl;
+      if (tsp.BestCircuitValue < DBL_MAX)
+	printf("[Reduced-cost fixing] %d of %d edges fixed to 0\n",
+	       lp.FixEdges(tsp.BestCircuitValue),tsp.NEdges);
+    }
+    for (EdgeIt e(g); e!=INVALID; ++e) x[e].set(GRB_CharAttr_VType,GRB_BINARY);
+
+    subtourelim cb(tsp , x, rootlp);
+    model.setCallback(&cb);
+    
     if (cutoff > 0) model.getEnv().set(GRB_DoubleParam_Cutoff, cutoff );
     model.update(); // Process any pending model modifications.
     model.optimize();
@@ -464,6 +1174,7 @@ int main(int argc, char *argv[])
       if (BinaryIsOne(x[e].get(GRB_DoubleAttr_X))) soma += weight[e];
 
     cout << "Solution cost = "<< soma << endl;
+    cb.Pool.PrintStatistics("Subtour cuts");
     Update_Circuit(tsp,x); // Update the circuit in x to tsp circuit variable (if better)
     ViewTspCircuit(tsp);
 
@@ -76,11 +76,12 @@ protected:
       double vcut;
       for (ArcIt a(g); a!=INVALID; ++a) 
 	capacity[a] = (this->*solution_value)(x[a]);  // or getSolution(x[a]);
+      DiMinCutSolver solver(g,capacity); // the same max-flow maps for all terminals
       
       for (int i=1;i< T.nt;i++) {
 	GRBLinExpr expr;
 	// find a mincut between root V[0] and other terminal
-	vcut = DiMinCut(g,capacity, T.V[0] , T.V[i], cut);
+	vcut = solver.Run(T.V[0] , T.V[i], cut);
 	if (vcut >= 1.0-MY_EPS) continue;
 
 	// found violated cut
@@ -0,0 +1,180 @@
+// Project and Analysis of Algorithms
+// Generate a random instance for the Capacitated Facility Location Problem,
+// in the text format read by ex_cflp or in the binary CFLP format (see
+// mygraphlib.h). Clients and facilities are random points in the region
+// [0,100)x[0,100) and the arc weights are euclidean distances. The instance
+// is written as a stream: only the facilities are kept in memory (the client
+// points are generated again, from the same seed, to write the arcs), so
+// instances with hundreds of thousands of clients can be generated. With
+// -k K, each client is connected only to its K nearest facilities, found
+// with a grid over the facility points; otherwise the bipartite digraph is
+// complete.
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "mygraphlib.h"
+#include "myutils.h"
+using namespace std;
+
+// Generator of the points of the clients or of the facilities. Each one has
+// its own erand48 stream, given by the seed and the stream id, so the same
+// points are obtained each time the generator is restarted.
+class CFLP_PointStream {
+public:
+  CFLP_PointStream(unsigned int seed,int id) {
+    Seed = seed+0x9E3779B9u*(unsigned int) id;  Restart();}
+  void Restart() {
+    Rand[0]=0x330E; Rand[1]=(unsigned short) (Seed&0xFFFF); Rand[2]=(unsigned short) (Seed>>16);}
+  void Next(double &x,double &y) {x = erand48(Rand)*100;  y = erand48(Rand)*100;}
+private:
+  unsigned int Seed;
+  unsigned short Rand[3];
+};
+
+// Grid over the facility points, to find the k nearest facilities of a client
+// visiting the cells in rings around the cell of the client.
+class CFLP_FacilityGrid {
+public:
+  CFLP_FacilityGrid(const vector<double> &fx,const vector<double> &fy);
+  // Put in near the k nearest facilities of (x,y), nearest first
+  void Nearest(double x,double y,int k,vector<pair<double,int> > &near);
+private:
+  const vector<double> &FX,&FY;
+  int G;              // the grid has G x G cells
+  double CellSize;
+  vector<int> Start;  // the facilities of cell c are Fac[Start[c]..Start[c+1]-1]
+  vector<int> Fac;
+  int Cell(double v) {int c=(int) (v/CellSize); return(c<0?0:(c>=G?G-1:c));}
+};
+
+CFLP_FacilityGrid::CFLP_FacilityGrid(const vector<double> &fx,const vector<double> &fy)
+  : FX(fx),FY(fy)
+{
+  int nF=(int) fx.size();
+  G = max(1,(int) sqrt(nF/2.0));  // about 2 facilities in each cell
+  CellSize = 100.0/G;
+  Start.assign(G*G+1,0);  Fac.resize(nF);
+  for (int j=0;j<nF;j++) Start[Cell(FY[j])*G+Cell(FX[j])+1]++;
+  for (int c=0;c<G*G;c++) Start[c+1] += Start[c];
+  vector<int> pos(Start.begin(),Start.end()-1);
+  for (int j=0;j<nF;j++) Fac[pos[Cell(FY[j])*G+Cell(FX[j])]++] = j;
+}
+
+void CFLP_FacilityGrid::Nearest(double x,double y,int k,vector<pair<double,int> > &near)
+{
+  int cx=Cell(x),cy=Cell(y);
+  near.clear();  // max-heap with the k nearest facilities found so far
+  for (int r=0;r<G;r++) {
+    // a facility outside the rings 0..r-1 is at distance at least (r-1)*CellSize
+    if ((int) near.size()==k && near.front().first <= (r-1)*CellSize) break;
+    for (int i=max(0,cy-r);i<=min(G-1,cy+r);i++)
+      for (int j=max(0,cx-r);j<=min(G-1,cx+r);j++) {
+	if (max(abs(i-cy),abs(j-cx))!=r) continue; // only the cells of ring r
+	for (int p=Start[i*G+j];p<Start[i*G+j+1];p++) {
+	  int f=Fac[p];
+	  double d=sqrt((FX[f]-x)*(FX[f]-x)+(FY[f]-y)*(FY[f]-y));
+	  if ((int) near.size()<k) {near.push_back(make_pair(d,f)); push_heap(near.begin(),near.end());}
+	  else if (d<near.front().first) {
+	    pop_heap(near.begin(),near.end());  near.back()=make_pair(d,f);
+	    push_heap(near.begin(),near.end());}
+	}
+      }
+  }
+  sort_heap(near.begin(),near.end());
+}
+
+
+int main(int argc, char *argv[])
+{
+  int nC,nF,Cap,k=0;
+  unsigned int seed=1;
+  double cost=100;
+  bool binary=false;
+  string filename;
+  vector<string> args;
+
+  for (int i=1;i<argc;i++) {
+    string arg=argv[i];
+    if (arg=="-k" && i+1<argc) k = atoi(argv[++i]);
+    else if (arg=="-seed" && i+1<argc) seed = (unsigned int) strtoul(argv[++i],NULL,10);
+    else if (arg=="-cost" && i+1<argc) cost = atof(argv[++i]);
+    else if (arg=="-binary") binary = true;
+    else args.push_back(arg);
+  }
+  if (args.size()!=4) {
+    cout<<"Usage: "<< argv[0]<<" <number_of_clients> <number_of_facilities> <capacity> <output_filename>"<<endl<<
+      "          [-k <K>] [-seed <seed>] [-cost <facility_weight>] [-binary]"<<endl<<
+      "       -k: connect each client only to its K nearest facilities (the instance"<<endl<<
+      "           may become infeasible if K is too small)"<<endl<<
+      "       -seed: the same seed always gives the same instance (default 1)"<<endl<<
+      "       -cost: weight of each facility (default 100)"<<endl<<
+      "       -binary: write the binary CFLP format, also read by ex_cflp"<<endl<<
+      "Example: "<< argv[0]<<" 100 30 15 digr_cflp_100"<<endl<<
+      "         "<< argv[0]<<" 200000 2000 150 cflp_200k.bin -k 20 -seed 7 -binary"<<endl;
+    exit(0);}
+  nC = atoi(args[0].c_str());  nF = atoi(args[1].c_str());  Cap = atoi(args[2].c_str());
+  filename = args[3];
+  if (nC<=0 || nF<=0 || Cap<=0 || k<0) {cout<<"The number of clients, facilities and the capacity must be positive."<<endl; exit(0);}
+  if (k==0 || k>nF) k = nF;
+  if ((double) nF*Cap < nC) cout<<"Warning: the total capacity is smaller than the number of clients."<<endl;
+
+  FILE *out = fopen(filename.c_str(),binary?"wb":"w");
+  if (out==NULL) {cout<<"Could not open file "<<filename<<"."<<endl; exit(1);}
+  setvbuf(out,NULL,_IOFBF,1<<20);
+  uint64_t narcs = (uint64_t) nC*k;
+
+  CFLP_PointStream cstream(seed,0),fstream(seed,1);
+  vector<double> fx(nF),fy(nF);
+  for (int j=0;j<nF;j++) fstream.Next(fx[j],fy[j]);
+
+  // nodes: the clients and then the facilities
+  if (binary) {
+    CFLPBinaryHeader h;
+    memcpy(h.magic,CFLP_BINARY_MAGIC,8);
+    h.nclients = nC;  h.nfacilities = nF;  h.narcs = narcs;
+    fwrite(&h,sizeof(h),1,out);
+    CFLPBinaryNode v;
+    for (int i=0;i<nC;i++) {
+      cstream.Next(v.x,v.y);  v.weight = 0;  v.capacity = 0;
+      fwrite(&v,sizeof(v),1,out);}
+    for (int j=0;j<nF;j++) {
+      v.x = fx[j];  v.y = fy[j];  v.weight = cost;  v.capacity = Cap;
+      fwrite(&v,sizeof(v),1,out);}
+  } else {
+    fprintf(out,"%d %llu\n",nC+nF,(unsigned long long) narcs);
+    for (int i=0;i<nC;i++) {
+      double x,y;
+      cstream.Next(x,y);
+      fprintf(out,"c%d %.6f %.6f\n",i+1,x,y);}
+    for (int j=0;j<nF;j++)
+      fprintf(out,"f%d %.6f %.6f %.6f %d\n",j+1,fx[j],fy[j],cost,Cap);
+  }
+
+  // arcs: for each client, its k nearest facilities (or all of them)
+  CFLP_FacilityGrid grid(fx,fy);
+  vector<pair<double,int> > near;
+  cstream.Restart();
+  for (int i=0;i<nC;i++) {
+    double x,y;
+    cstream.Next(x,y);
+    if (k<nF) grid.Nearest(x,y,k,near);
+    else {
+      near.resize(nF);
+      for (int j=0;j<nF;j++) near[j] = make_pair(sqrt((fx[j]-x)*(fx[j]-x)+(fy[j]-y)*(fy[j]-y)),j);
+    }
+    for (int p=0;p<(int) near.size();p++) {
+      if (binary) {
+	CFLPBinaryArc a;
+	a.client = i;  a.facility = near[p].second;  a.weight = near[p].first;
+	fwrite(&a,sizeof(a),1,out);
+      } else fprintf(out,"c%d f%d %.6f\n",i+1,near[p].second+1,near[p].first);
+    }
+  }
+  if (ferror(out) || fclose(out)!=0) {cout<<"Error writing file "<<filename<<"."<<endl; exit(1);}
+  cout<<"Wrote "<<filename<<" with "<<nC<<" clients, "<<nF<<" facilities and "<<narcs<<" arcs."<<endl;
+  return(0);
+}
@@ -2,15 +2,71 @@
 #include <stdlib.h>
 #include <iostream>
 #include <fstream>
+#include <lemon/list_graph.h>
+#include "mygraphlib.h"
+#include "myutils.h"
+using namespace lemon;
 using namespace std;
-int main(int argc, char *argv[]) 
+
+// Generate n random points with integer coordinates in 1..1000 (or, with
+// -real, real coordinates in [0,1000)). The points are kept in an
+// EuclideanGraph (O(n) memory) and the output is only the points, in the
+// format <n> -1 of the complete euclidean graphs, or, with -knn k, a graph
+// with the edges to the k nearest neighbours of each point.
+int main(int argc, char *argv[])
 {
-  int n;
+  int n=0,k=0;
+  bool real=false,ok=(argc>=2);
+  EuclideanGraph eg;
   srand48(clock());
-  if (argc!=2) {cout<<"Usage: "<< argv[0]<<" <number_of_nodes>"<<endl; exit(0);} 
-  n = atoi(argv[1]);
-  cout << n << " -1" << endl;
-  for (int i=0;i<n;i++) 
-    // format of each line: Node_name  x-coordinate  y-coordinate
-    cout << i+1 << " " <<  ((int) (drand48()*1000)+1) << " " << ((int) (drand48()*1000)+1) << endl;
+  for (int i=2;i<argc && ok;i++) {
+    if (string(argv[i])=="-real") real = true;
+    else if ((string(argv[i])=="-knn") && (i+1<argc)) ok = ((k = atoi(argv[++i])) > 0);
+    else ok = false;
+  }
+  if (ok) n = atoi(argv[1]);
+  if (!ok || (n<=0)) {
+    cout<<"Usage: "<< argv[0]<<" <number_of_nodes> [-knn <k>] [-real]"<<endl<<
+      "       -knn: write only the edges from each node to its k nearest neighbours,"<<endl<<
+      "             instead of the points of a complete euclidean graph"<<endl<<
+      "       -real: real coordinates in [0,1000), instead of integers in 1..1000"<<endl;
+    exit(0);}
+  if (real) GenerateRandomEuclideanGraph(eg,n,1000,1000);
+  else {
+    eg.Reserve(n);
+    for (int i=0;i<n;i++) {
+      int x=((int) (drand48()*1000)+1),y=((int) (drand48()*1000)+1);
+      eg.AddNode(IntToString(i+1),x,y);
+    }
+  }
+  // coordinates are written as integers, unless -real
+  const char *nodeformat = real ? "%s %.6f %.6f\n" : "%s %.0f %.0f\n";
+  if (k==0) {
+    printf("%d -1\n",n);
+    for (int i=0;i<n;i++)
+      // format of each line: Node_name  x-coordinate  y-coordinate
+      printf(nodeformat,eg.vname[i].c_str(),eg.posx[i],eg.posy[i]);
+    return(0);
+  }
+  if (k>n-1) k = n-1;
+  eg.BuildCandidates(k);
+  // edge {u,v} is written once, by u, if v is a candidate of u and
+  // (v>u or u is not a candidate of v)
+  vector<pair<int,int> > edges;
+  for (int u=0;u<n;u++)
+    for (int i=0;i<eg.Ncandidates;i++) {
+      int v=eg.Candidates(u)[i],j;
+      if (v<u) {
+	for (j=0;j<eg.Ncandidates && eg.Candidates(v)[j]!=u;j++);
+	if (j<eg.Ncandidates) continue;
+      }
+      edges.push_back(make_pair(u,v));
+    }
+  printf("%d %d\n",n,(int) edges.size());
+  for (int i=0;i<n;i++)
+    printf(nodeformat,eg.vname[i].c_str(),eg.posx[i],eg.posy[i]);
+  for (unsigned i=0;i<edges.size();i++)
+    printf("%s %s %.6f\n",eg.vname[edges[i].first].c_str(),eg.vname[edges[i].second].c_str(),
+	   eg.Cost(edges[i].first,edges[i].second));
+  return(0);
 }
@@ -5,329 +5,922 @@
 #include <gurobi_c++.h>
 #include <float.h>
 #include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <set>
-#include <unordered_map>
+#include <thread>
 #include <lemon/list_graph.h>
 #include <lemon/gomory_hu.h>
 #include "mygraphlib.h"
 
+/*
+ * Adjacency matrix packed with one bit per pair of nodes. Nodes are indexed by their position, given by
+ * position[id(v)], so rows can be combined with bitmaps over the same positions.
+ * Each row is stored as a contiguous run of 64-bit words.
+ */
+class BitAdjacencyMatrix {
+private:
+    int wordsPerRow = 0;
+    vector<uint64_t> bits;
+
+public:
+    BitAdjacencyMatrix(const ListGraph &g, const vector<int> &position) {
+        int numberOfNodes = static_cast<int>(position.size());
+        wordsPerRow = (numberOfNodes + 63) / 64;
+        bits.assign(static_cast<size_t>(numberOfNodes) * wordsPerRow, 0);
+        for (EdgeIt e(g); e != INVALID; ++e) {
+            int u = position[lemon::ListGraph::id(g.u(e))];
+            int v = position[lemon::ListGraph::id(g.v(e))];
+            bits[static_cast<size_t>(u) * wordsPerRow + (v >> 6)] |= uint64_t(1) << (v & 63);
+            bits[static_cast<size_t>(v) * wordsPerRow + (u >> 6)] |= uint64_t(1) << (u & 63);
+        }
+    }
+
+    // Number of 64-bit words in each row.
+    int rowWords() const {
+        return wordsPerRow;
+    }
+
+    // Words of the row of position 'u'.
+    const uint64_t *row(int u) const {
+        return &bits[static_cast<size_t>(u) * wordsPerRow];
+    }
+
+    // Return true if positions 'u' and 'v' are adjacent.
+    bool adjacent(int u, int v) const {
+        return (row(u)[v >> 6] >> (v & 63)) & 1;
+    }
+};
+
+/*
+ * Set of nodes that cannot join the current partial solution, i.e., the union of the neighbourhoods of the nodes
+ * already in it. One mask is kept per solution depth so that removing the last node of the solution only drops a level.
+ */
+class ForbiddenMask {
+private:
+    int wordsPerRow = 0;
+    int depth = 0;
+    vector<uint64_t> levels;
+
+public:
+    explicit ForbiddenMask(const BitAdjacencyMatrix &adjacency) : wordsPerRow(adjacency.rowWords()),
+                                                                levels(static_cast<size_t>(wordsPerRow), 0) {}
+
+    // Add the neighbourhood of a node that was inserted in the solution.
+    void push(const uint64_t *row) {
+        levels.resize(static_cast<size_t>(depth + 2) * wordsPerRow);
+        const uint64_t *top = &levels[static_cast<size_t>(depth) * wordsPerRow];
+        uint64_t *next = &levels[static_cast<size_t>(depth + 1) * wordsPerRow];
+        for (int i = 0; i < wordsPerRow; i++) {
+            next[i] = top[i] | row[i];
+        }
+        depth++;
+    }
+
+    // Undo the last push, when the last node of the solution is removed.
+    void pop() {
+        depth--;
+    }
+
+    // Return true if position 'v' is adjacent to some node of the solution.
+    bool test(int v) const {
+        return (words()[v >> 6] >> (v & 63)) & 1;
+    }
+
+    // Words of the mask of the current solution.
+    const uint64_t *words() const {
+        return &levels[static_cast<size_t>(depth) * wordsPerRow];
+    }
+};
+
+/*
+ * Options of the max_ind_set search.
+ */
+struct SearchOptions {
+    // Bounds evaluated, in order, to prune the search.
+    vector<string> bounds = {"dantzig"};
+    // Number of threads, the search is sequential if it is 1.
+    int threads = 1;
+    // Number of nodes fixed in the solution to split the tree in subproblems, in the parallel search.
+    int splitDepth = 2;
+    // Limits of the search, 0 means no limit. Once one is reached the search stops and returns the best solution found.
+    double timeLimit = 0;
+    long long nodeLimit = 0;
+    // Called with the value and weight of each solution better than the ones found before, and the time it was found.
+    function<void(int value, int weight, double seconds)> onIncumbent;
+    // Reduce the graph and split it in connected components before the search.
+    bool reduce = false;
+};
+
+/*
+ * Counters of one bound used by the search.
+ */
+struct BoundStatistics {
+    string name;
+    long long evaluations;
+    long long pruned;
+};
+
+/*
+ * Counters reported by the max_ind_set search.
+ */
+struct SearchStatistics {
+    long long backtracks = 0;
+    // Nodes inserted in the solution along the search.
+    long long nodes = 0;
+    double seconds = 0;
+    // False if the search stopped at a limit, then the optimum is at most upperBound.
+    bool optimal = true;
+    int upperBound = 0;
+    vector<BoundStatistics> bounds;
+    // Results of the reductions: nodes removed, connected components left and nodes left to the search.
+    int removedNodes = 0;
+    int components = 0;
+    int searchedNodes = 0;
+};
+
 /**
- * A List Node with denormalized data for easy access
+ * A node with denormalized data for easy access
  */
-struct ListNode {
+struct RankedNode {
     Node data;
     int value = 0;
     int weight = 0;
     // Value/weight ratio
     float valuePerWeight = 0.0;
-    ListNode *next = nullptr;
-    ListNode *previous = nullptr;
-
 };
 
+// Order used to rank the nodes: larger valuePerWeight first, then lighter, then smaller id.
+bool rankedBefore(const RankedNode &a, const RankedNode &b) {
+    if (a.valuePerWeight != b.valuePerWeight) {
+        return a.valuePerWeight > b.valuePerWeight;
+    }
+    if (a.weight != b.weight) {
+        return a.weight < b.weight;
+    }
+    return lemon::ListGraph::id(a.data) < lemon::ListGraph::id(b.data);
+}
+
 /*
- * Ordered Linked List with helper methods for IndependentSet.
+ * Set of candidate nodes for IndependentSet. The nodes are ranked once in an array sorted by rankedBefore and the pool
+ * is a bitmap over the ranks, so iterating it visits the nodes in valuePerWeight order and inserting or removing a
+ * node is O(1).
  */
-class OrderedLinkedNodeList {
+class CandidatePool {
 private:
-    ListNode *head = nullptr;
-    ListNode *tail = nullptr;
+    vector<uint64_t> members;
     int size = 0;
 
 public:
-    OrderedLinkedNodeList() {};
+    static const int NONE = -1;
 
-    // Insert a node ordered by valuePerWeight.
-    void insertOrdered(ListNode *node) {
+    explicit CandidatePool(int numberOfRanks) : members(static_cast<size_t>((numberOfRanks + 63) / 64), 0) {};
+
+    // Insert the node of the given rank.
+    void insert(int rank) {
+        members[rank >> 6] |= uint64_t(1) << (rank & 63);
         size++;
-        // If the list is empty initialize it with both head and tail pointing to node.
-        if (head == nullptr) {
-            head = node;
-            tail = node;
-            return;
+    }
+
+    // Remove the node of the given rank.
+    void remove(int rank) {
+        members[rank >> 6] &= ~(uint64_t(1) << (rank & 63));
+        size--;
+    }
+
+    // Smallest rank in the pool, or NONE.
+    int first() const {
+        return next(NONE);
+    }
+
+    // Smallest rank in the pool greater than 'rank', or NONE.
+    int next(int rank) const {
+        int start = rank + 1;
+        size_t w = static_cast<size_t>(start >> 6);
+        if (w >= members.size()) {
+            return NONE;
         }
-        ListNode *current = head;
-        while (current != nullptr &&
-               (current->valuePerWeight > node->valuePerWeight ||
-                (current->valuePerWeight == node->valuePerWeight && current->weight < node->weight) ||
-                (current->valuePerWeight == node->valuePerWeight && current->weight == node->weight &&
-                 lemon::ListGraph::id(current->data) < lemon::ListGraph::id(node->data)))) {
-            current = current->next;
+        uint64_t word = members[w] & (~uint64_t(0) << (start & 63));
+        while (word == 0) {
+            if (++w == members.size()) {
+                return NONE;
+            }
+            word = members[w];
         }
+        return static_cast<int>(w * 64) + __builtin_ctzll(word);
+    }
 
-        // If its inserting in the start update head.
-        if (current == head) {
-            node->next = head;
-            head->previous = node;
-            head = node;
+    // Move to 'other' every node of this pool with rank greater than 'rank'.
+    void moveAfter(int rank, CandidatePool &other) {
+        int start = rank + 1;
+        size_t w = static_cast<size_t>(start >> 6);
+        if (w >= members.size()) {
             return;
         }
-
-        // If its inserting in the end update tail.
-        if (current == nullptr) {
-            tail->next = node;
-            node->previous = tail;
-            tail = node;
-            return;
+        uint64_t mask = ~uint64_t(0) << (start & 63);
+        for (; w < members.size(); w++, mask = ~uint64_t(0)) {
+            uint64_t moved = members[w] & mask;
+            int count = __builtin_popcountll(moved);
+            members[w] &= ~moved;
+            other.members[w] |= moved;
+            size -= count;
+            other.size += count;
         }
+    }
 
-        node->next = current;
-        node->previous = current->previous;
-        current->previous->next = node;
-        current->previous = node;
+    // Move all nodes of this pool to 'other'.
+    void moveAll(CandidatePool &other) {
+        moveAfter(NONE, other);
     }
 
-    // Inserts at the end. Only used when it is sure 'node' has the lowest valuePerWeight.
-    void insert(ListNode *node) {
-        size++;
-        if (head == nullptr) {
-            head = node;
-            tail = node;
-            return;
-        }
-        tail->next = node;
-        node->previous = tail;
-        tail = node;
+    // Pool length.
+    int length() const {
+        return size;
     }
 
-    // Get head without removing.
-    ListNode *peak() {
-        return head;
+    // Return true if pool is empty.
+    bool empty() const {
+        return size == 0;
     }
 
-    // Get tail without removing.
-    ListNode *peakBottom() {
-        return tail;
+    // Number of 64-bit words of the bitmap.
+    int numberOfWords() const {
+        return static_cast<int>(members.size());
     }
 
-    // Get head and remove.
-    ListNode *top() {
-        // if the list was empty return nullptr
-        if (empty()) {
-            return nullptr;
-        }
-        size--;
-        ListNode *fetch_node = head;
-        // if its the last element clear pointers and returns
-        if (empty()) {
-            head = nullptr;
-            tail = nullptr;
-            return fetch_node;
-        }
-        head = head->next;
-        head->previous = nullptr;
-        fetch_node->next = nullptr;
-        fetch_node->previous = nullptr;
-        return fetch_node;
-    }
-
-    // Get tail and remove.
-    ListNode *bottom() {
-        // if the list was empty return nullptr
-        if (empty()) {
-            return nullptr;
-        }
-        size--;
-        ListNode *fetch_node = tail;
-        // if its the last element clear pointers and returns
-        if (empty()) {
-            head = nullptr;
-            tail = nullptr;
-            return fetch_node;
-        }
-        tail = tail->previous;
-        tail->next = nullptr;
-        return fetch_node;
-    }
-
-    // Verify if can insert the node in this Solution list. Checks if it will continue independent and with weight below capacity.
-    bool canInsertInSolution(ListNode *node, const ListGraph &graph, const vector<vector<int>> &edges,
-                             int remaining_weight) {
-        if (remaining_weight < node->weight) {
-            return false;
+    // Words of the bitmap.
+    const uint64_t *words() const {
+        return members.data();
+    }
+};
+
+/*
+ * Upper bound on the value that can still be added to a partial solution using the nodes of the available pool.
+ * Each bound counts how many times it was evaluated and how many times it pruned the search.
+ */
+class UpperBound {
+public:
+    long long evaluations = 0;
+    long long pruned = 0;
+
+    virtual ~UpperBound() {};
+
+    // Name used to select the bound in the command line.
+    virtual string name() const = 0;
+
+    virtual int estimate(const CandidatePool &available, const ForbiddenMask &forbidden, int remaining_weight) = 0;
+};
+
+/*
+ * Fractional knapsack (Dantzig) bound over the whole available pool, without looking at the edges.
+ */
+class DantzigBound : public UpperBound {
+private:
+    const vector<RankedNode> &nodes;
+
+public:
+    explicit DantzigBound(const vector<RankedNode> &rankedNodes) : nodes(rankedNodes) {};
+
+    string name() const override {
+        return "dantzig";
+    }
+
+    int estimate(const CandidatePool &available, const ForbiddenMask &forbidden, int remaining_weight) override {
+        (void) forbidden;
+        const uint64_t *members = available.words();
+        int estimative = 0;
+        for (int w = 0; w < available.numberOfWords() && remaining_weight > 0; w++) {
+            uint64_t word = members[w];
+            while (word != 0) {
+                const RankedNode &node = nodes[w * 64 + __builtin_ctzll(word)];
+                word &= word - 1;
+                // if the item does not fit completely estimate it partially
+                if (node.weight > remaining_weight) {
+                    float partial_value = (float) remaining_weight / (float) node.weight;
+                    estimative += (int) ceil((float) node.value * partial_value);
+                    return estimative;
+                }
+                estimative += node.value;
+                remaining_weight -= node.weight;
+                if (remaining_weight == 0) {
+                    return estimative;
+                }
+            }
         }
-        ListNode *current = head;
-        while (current != nullptr) {
-            if (edges[lemon::ListGraph::id(node->data)][lemon::ListGraph::id(current->data)] == 1) {
-                return false;
+        return estimative;
+    }
+};
+
+/*
+ * Base of the bounds that only consider the available nodes that still fit: not adjacent to the solution and not
+ * heavier than the remaining capacity. Their positions are collected in rank order in 'items'.
+ */
+class FeasibleItemsBound : public UpperBound {
+protected:
+    const vector<RankedNode> &nodes;
+    vector<int> items;
+
+    void collectItems(const CandidatePool &available, const ForbiddenMask &forbidden, int remaining_weight) {
+        const uint64_t *members = available.words();
+        const uint64_t *forbiddenWords = forbidden.words();
+        items.clear();
+        for (int w = 0; w < available.numberOfWords(); w++) {
+            uint64_t word = members[w] & ~forbiddenWords[w];
+            while (word != 0) {
+                int rank = w * 64 + __builtin_ctzll(word);
+                word &= word - 1;
+                if (nodes[rank].weight <= remaining_weight) {
+                    items.push_back(rank);
+                }
             }
-            current = current->next;
         }
-        return true;
     }
 
-    // List length.
-    int length() {
-        return size;
+public:
+    explicit FeasibleItemsBound(const vector<RankedNode> &rankedNodes) : nodes(rankedNodes) {};
+};
+
+/*
+ * Optimal 0-1 knapsack over the feasible available nodes, by dynamic programming over the remaining capacity.
+ * Exact for the knapsack relaxation, but costs O(|items| * remaining_weight) per evaluation.
+ */
+class KnapsackBound : public FeasibleItemsBound {
+private:
+    vector<int> best;
+
+public:
+    explicit KnapsackBound(const vector<RankedNode> &rankedNodes) : FeasibleItemsBound(rankedNodes) {};
+
+    string name() const override {
+        return "knapsack";
     }
 
-    // REturn true if list is empty.
-    bool empty() {
-        return size == 0;
+    int estimate(const CandidatePool &available, const ForbiddenMask &forbidden, int remaining_weight) override {
+        collectItems(available, forbidden, remaining_weight);
+        best.assign(static_cast<size_t>(remaining_weight + 1), 0);
+        for (int rank : items) {
+            const RankedNode &node = nodes[rank];
+            for (int c = remaining_weight; c >= node.weight; c--) {
+                best[c] = max(best[c], best[c - node.weight] + node.value);
+            }
+        }
+        return best[remaining_weight];
     }
+};
+
+/*
+ * Martello-Toth (U2) bound: the fractional knapsack bound is improved by deciding the critical item, either removing
+ * it and filling the capacity with the next item or forcing it in and removing part of the previous one.
+ */
+class MartelloTothBound : public FeasibleItemsBound {
+public:
+    explicit MartelloTothBound(const vector<RankedNode> &rankedNodes) : FeasibleItemsBound(rankedNodes) {};
 
-    // Clear list.
-    void clear() {
-        head = tail = nullptr;
-        size = 0;
+    string name() const override {
+        return "mt";
     }
 
-    // Estimate max value without looking at the edges
-    int estimate(int remaining_weight) {
+    int estimate(const CandidatePool &available, const ForbiddenMask &forbidden, int remaining_weight) override {
+        collectItems(available, forbidden, remaining_weight);
         int estimative = 0;
-        ListNode *current = head;
-        while (remaining_weight > 0 && current != nullptr) {
-            // if the item does not fit completely estimate it partially
-            if (current->weight > remaining_weight) {
-                float partial_value = (float) remaining_weight / (float) current->weight;
-                estimative += (int) ceil((float) current->value * partial_value);
-                remaining_weight = 0;
-                current = current->next;
+        size_t critical = 0;
+        while (critical < items.size() && nodes[items[critical]].weight <= remaining_weight) {
+            estimative += nodes[items[critical]].value;
+            remaining_weight -= nodes[items[critical]].weight;
+            critical++;
+        }
+        // All items fit.
+        if (critical == items.size()) {
+            return estimative;
+        }
+        // The critical item is left out, the capacity is filled with the next one.
+        int without = 0;
+        if (critical + 1 < items.size()) {
+            const RankedNode &next = nodes[items[critical + 1]];
+            without = (int) floor((double) remaining_weight * next.value / next.weight);
+        }
+        // The critical item is forced in, space is made removing part of the previous one. As no item heavier than
+        // the capacity is collected, the critical item is never the first one.
+        const RankedNode &node = nodes[items[critical]];
+        const RankedNode &previous = nodes[items[critical - 1]];
+        int with = (int) floor(node.value -
+                               (double) (node.weight - remaining_weight) * previous.value / previous.weight);
+        return estimative + max(without, with);
+    }
+};
+
+/*
+ * Clique cover bound: the feasible available nodes are greedily partitioned in cliques, of which an independent set
+ * uses at most one node. Each clique is replaced by one item with its largest value and smallest weight, and the
+ * fractional knapsack bound is taken over these items.
+ */
+class CliqueCoverBound : public FeasibleItemsBound {
+private:
+    struct CliqueItem {
+        int value;
+        int weight;
+    };
+
+    const BitAdjacencyMatrix &adjacency;
+    vector<uint64_t> uncovered, common;
+    vector<CliqueItem> cliques;
+
+public:
+    CliqueCoverBound(const vector<RankedNode> &rankedNodes, const BitAdjacencyMatrix &adjacencyMatrix)
+            : FeasibleItemsBound(rankedNodes), adjacency(adjacencyMatrix) {};
+
+    string name() const override {
+        return "clique";
+    }
+
+    int estimate(const CandidatePool &available, const ForbiddenMask &forbidden, int remaining_weight) override {
+        collectItems(available, forbidden, remaining_weight);
+        int numberOfWords = adjacency.rowWords();
+        uncovered.assign(static_cast<size_t>(numberOfWords), 0);
+        common.resize(static_cast<size_t>(numberOfWords));
+        for (int rank : items) {
+            uncovered[rank >> 6] |= uint64_t(1) << (rank & 63);
+        }
+
+        // Each clique starts at the best ranked uncovered node and grows with the best ranked uncovered node adjacent
+        // to all its members.
+        cliques.clear();
+        for (int rank : items) {
+            if (!((uncovered[rank >> 6] >> (rank & 63)) & 1)) {
                 continue;
             }
-            estimative += current->value;
-            remaining_weight -= current->weight;
-            current = current->next;
+            CliqueItem clique = {nodes[rank].value, nodes[rank].weight};
+            int member = rank;
+            for (int w = 0; w < numberOfWords; w++) {
+                common[w] = uncovered[w];
+            }
+            while (member >= 0) {
+                uncovered[member >> 6] &= ~(uint64_t(1) << (member & 63));
+                clique.value = max(clique.value, nodes[member].value);
+                clique.weight = min(clique.weight, nodes[member].weight);
+                const uint64_t *row = adjacency.row(member);
+                member = -1;
+                for (int w = 0; w < numberOfWords; w++) {
+                    common[w] &= row[w];
+                    if (member < 0 && common[w] != 0) {
+                        member = w * 64 + __builtin_ctzll(common[w]);
+                    }
+                }
+            }
+            cliques.push_back(clique);
+        }
+
+        sort(cliques.begin(), cliques.end(), [](const CliqueItem &a, const CliqueItem &b) {
+            return (long long) a.value * b.weight > (long long) b.value * a.weight;
+        });
+        int estimative = 0;
+        for (const CliqueItem &clique : cliques) {
+            if (clique.weight > remaining_weight) {
+                return estimative + (int) ((long long) remaining_weight * clique.value / clique.weight);
+            }
+            estimative += clique.value;
+            remaining_weight -= clique.weight;
         }
         return estimative;
     }
+};
+
+// Names of the bounds that can be selected in the command line.
+const vector<string> UPPER_BOUND_NAMES = {"dantzig", "knapsack", "mt", "clique"};
+
+// Build the bound with the given name, one of UPPER_BOUND_NAMES (the names are checked by ParseSearchOption).
+UpperBound *newUpperBound(const string &name, const vector<RankedNode> &nodes, const BitAdjacencyMatrix &adjacency) {
+    if (name == "dantzig") return new DantzigBound(nodes);
+    if (name == "knapsack") return new KnapsackBound(nodes);
+    if (name == "mt") return new MartelloTothBound(nodes);
+    if (name == "clique") return new CliqueCoverBound(nodes, adjacency);
+    cout << "Unknown bound " << name << "." << endl;
+    exit(1);
+}
 
-    // Convert this list to set<Node>
-    set<Node> toSet() {
-        set<Node> independentSet;
-        ListNode *current = head;
-        while (current != nullptr) {
-            independentSet.insert(current->data);
-            current = current->next;
+/*
+ * Sequence of bounds evaluated from the first to the last. The search is pruned by the first bound that proves the
+ * partial solution cannot beat the best known one, so cheap bounds should come first.
+ */
+class BoundChain {
+private:
+    vector<unique_ptr<UpperBound>> bounds;
+
+public:
+    BoundChain(const vector<string> &names, const vector<RankedNode> &nodes, const BitAdjacencyMatrix &adjacency) {
+        for (const string &name : names) {
+            bounds.push_back(unique_ptr<UpperBound>(newUpperBound(name, nodes, adjacency)));
         }
-        return independentSet;
     }
 
-    // Remove node from this list.
-    ListNode *remove(ListNode *node) {
-        size--;
-        if (node == head) {
-            head = node->next;
-        } else {
-            node->previous->next = node->next;
-        }
-        if (node == tail) {
-            tail = node->previous;
-        } else {
-            node->next->previous = node->previous;
+    // Evaluate the bounds and return the smallest of current_solution plus each estimate. The evaluation stops at the
+    // first bound that prunes the partial solution, i.e., whose value is not greater than 'threshold'.
+    int evaluate(int current_solution, int threshold, const CandidatePool &available, const ForbiddenMask &forbidden,
+                 int remaining_weight) {
+        int smallest = INT32_MAX;
+        for (auto &bound : bounds) {
+            bound->evaluations++;
+            int value = current_solution + bound->estimate(available, forbidden, remaining_weight);
+            smallest = min(smallest, value);
+            if (value <= threshold) {
+                bound->pruned++;
+                break;
+            }
         }
-        node->next = nullptr;
-        node->previous = nullptr;
-        return node;
+        return smallest;
     }
 
-    // Soft copy of this list.
-    void copy(OrderedLinkedNodeList list) {
-        head = list.head;
-        tail = list.tail;
-        size = list.size;
+    // Return the smallest of current_solution plus each estimate, without pruning nor updating the counters.
+    int evaluate(int current_solution, const CandidatePool &available, const ForbiddenMask &forbidden,
+                 int remaining_weight) {
+        int smallest = INT32_MAX;
+        for (auto &bound : bounds) {
+            smallest = min(smallest, current_solution + bound->estimate(available, forbidden, remaining_weight));
+        }
+        return smallest;
     }
 
-    // Print the current nodes in this list.
-    void print() {
-        ListNode *current = head;
-        while (current != nullptr) {
-            cout << lemon::ListGraph::id(current->data) << "  ";
-            current = current->next;
+    // Add the counters of each bound to 'statistics'.
+    void report(vector<BoundStatistics> &statistics) const {
+        if (statistics.size() != bounds.size()) {
+            statistics.clear();
+            for (auto &bound : bounds) {
+                BoundStatistics boundStatistics = {bound->name(), 0, 0};
+                statistics.push_back(boundStatistics);
+            }
+        }
+        for (size_t i = 0; i < bounds.size(); i++) {
+            statistics[i].evaluations += bounds[i]->evaluations;
+            statistics[i].pruned += bounds[i]->pruned;
         }
-        cout << endl;
     }
+};
 
+// Convert the ranks of a solution to set<Node>
+set<Node> toSet(const vector<int> &solution, const vector<RankedNode> &nodes) {
+    set<Node> independentSet;
+    for (int rank : solution) {
+        independentSet.insert(nodes[rank].data);
+    }
+    return independentSet;
+}
+
+/*
+ * Partial state of the backtracking saved when the tree is split in subproblems: the pools, the solution stack and the
+ * bookkeeping of SearchState below.
+ */
+struct SearchSnapshot {
+    CandidatePool available, used;
+    vector<int> solution;
+    int clean_backtrack;
+    vector<int> pathGate;
 };
 
-bool ReadListGraph3(string filename,
-                    ListGraph &g,
-                    NodeStringMap &vname,
-                    NodeIntMap &weight,
-                    NodeIntMap &value,
-                    NodePosMap &posx,
-                    NodePosMap &posy,
-                    int &C) {
-    ifstream ifile;
-    int n, m;
-    Edge a;
-    string STR;
-    Node u, v;
-#if __cplusplus >= 201103L
-    std::unordered_map<string, Node> string2node;
-#else
-    std::tr1::unordered_map<string,Node> string2node;
-#endif
-    ifile.open(filename.c_str(), ios::in);
-    if (!ifile) {
-        cout << "File '" << filename << "' does not exist.\n";
-        exit(0);
+/*
+ * State of the max_ind_set backtracking: the available and used pools, the solution stack and the bounds. The search
+ * loops of the sequential and the parallel modes drive it by inserting candidates and backtracking.
+ *
+ * Besides the state the sequential algorithm needs, it keeps the gate of the current state: the smallest bound value
+ * evaluated in the states the search went through to reach it. A state is reached by a search whose best known value
+ * is M if and only if its gate is greater than M. pathGate[d] is the gate of the last state with d nodes in the
+ * solution and stateGate is the smallest bound evaluated in the current state.
+ */
+class SearchState {
+public:
+    const vector<RankedNode> &nodes;
+    const BitAdjacencyMatrix &adjacency;
+    CandidatePool available, used;
+    vector<int> solution;
+    ForbiddenMask forbidden;
+    BoundChain bounds;
+    int current_solution = 0;
+    int remaining_weight;
+    // clean_backtrack stores the 'primary' node in the solution, the one that was the last in the solution when
+    // the used pool was cleared the last time, once the solution bottom is the same as clean_backtrack once again,
+    // all the possibilities with this partial solution including this node has been fulfilled and the 'used' pool
+    // is restored as available.
+    int clean_backtrack = CandidatePool::NONE;
+    long long backtracks = 0;
+    long long inserted = 0;
+    vector<int> pathGate;
+    int stateGate = INT32_MAX;
+
+    SearchState(const vector<RankedNode> &rankedNodes, const BitAdjacencyMatrix &adjacencyMatrix,
+                const vector<string> &boundNames, int Capacity)
+            : nodes(rankedNodes), adjacency(adjacencyMatrix),
+              available(static_cast<int>(rankedNodes.size())), used(static_cast<int>(rankedNodes.size())),
+              forbidden(adjacencyMatrix), bounds(boundNames, rankedNodes, adjacencyMatrix), remaining_weight(Capacity),
+              pathGate(1, INT32_MAX) {
+        solution.reserve(rankedNodes.size());
     }
-    ifile >> n;
-    ifile >> m;
-    ifile >> C; // first line have number of nodes, number of arcs and capacity
 
-    if (m < 0 || ifile.eof()) {
-        cout << "File " << filename << " is not a digraph given by arcs.\n";
-        exit(0);
+    // Return true if no bound proves that the current state cannot reach a value greater than 'threshold'.
+    bool promising(int threshold) {
+        int value = bounds.evaluate(current_solution, threshold, available, forbidden, remaining_weight);
+        stateGate = min(stateGate, value);
+        return value > threshold;
+    }
+
+    // Evaluate the gate of the current state, without pruning nor counting the evaluations in the statistics.
+    void evaluateGate() {
+        stateGate = min(stateGate, bounds.evaluate(current_solution, available, forbidden, remaining_weight));
+    }
+
+    // Return true if the node of the given rank can be inserted keeping the solution independent and in the capacity.
+    bool fits(int rank) const {
+        return nodes[rank].weight <= remaining_weight && !forbidden.test(rank);
     }
 
-    // continue to read ifile, and insert information in g for the nex t n nodes
-    for (int i = 0; i < n; i++) {
+    // Move an available node to the solution.
+    void insert(int rank) {
+        size_t depth = solution.size();
+        pathGate[depth] = min(pathGate[depth], stateGate);
+        pathGate.resize(depth + 2);
+        pathGate[depth + 1] = pathGate[depth];
+        stateGate = INT32_MAX;
+        inserted++;
+        available.remove(rank);
+        solution.push_back(rank);
+        forbidden.push(adjacency.row(rank));
+        remaining_weight -= nodes[rank].weight;
+        current_solution += nodes[rank].value;
+    }
 
-        v = g.addNode();
-        string token;
-        ifile >> token;
-        string2node[token] = v;
-        vname[v] = token;
-        ifile >> weight[v];
-        ifile >> value[v];
-        posx[v] = 0.0;
-        posy[v] = 0.0;
+    // Gate of the current state.
+    int gate() const {
+        return pathGate[solution.size()];
+    }
 
+    // Remove the last node of the solution, moving it to the used pool. Return false if there is nothing left to
+    // backtrack, i.e., the search is over.
+    bool backtrack() {
+        // If matches the condition described above backtracks restoring available pool from used.
+        bool backtrack_cleared = false;
+        int solution_bottom = solution.empty() ? CandidatePool::NONE : solution.back();
+        if (clean_backtrack == solution_bottom) {
+            // If at this time the solution is empty there's no other viable solution candidate so it returns.
+            if (solution.empty()) {
+                return false;
+            }
+            // Restore the clean_backtrack to the empty state and merge used and available pools as available.
+            clean_backtrack = CandidatePool::NONE;
+            used.moveAll(available);
+            backtrack_cleared = true;
+        }
+
+        int backtracked = solution.back();
+        solution.pop_back();
+        forbidden.pop();
+        backtracks++;
+        stateGate = INT32_MAX;
+        current_solution -= nodes[backtracked].value;
+        remaining_weight += nodes[backtracked].weight;
+        if (!solution.empty()) {
+            // If used was empty set clean_backtrack.
+            if (used.empty()) {
+                clean_backtrack = solution.back();
+            }
+            used.insert(backtracked);
+            // If it was not a complete backtrack, restore the nodes that were added after (valuePerWeight >) to the available pool.
+            if (!backtrack_cleared) {
+                used.moveAfter(backtracked, available);
+            }
+        }
+        return true;
     }
 
-    // continue to read ifile, and obtain edge weights
-    string nomeu, nomev;
-    for (int i = 0; i < m; i++) {
-        // format: <node_u>   <node_v>   <edge_weight>
-        ifile >> nomeu;
-        ifile >> nomev;
-        if (ifile.eof()) {
-            cout << "Reached unexpected end of file.\n";
-            exit(0);
+    // Upper bound on the solutions the search has not visited yet, among those that keep the first 'fromDepth' nodes
+    // of the solution. Their nodes are in the pools or in the solution, as a node only leaves all of them when it is
+    // removed from a solution of one node. They are split by the first node of the solution they leave out: for each
+    // depth d, the ones that keep the first d nodes but not the next one, plus the ones that keep the whole solution.
+    // The bound is the largest among all the bounds of each part.
+    int openUpperBound(size_t fromDepth) const {
+        BoundChain allBounds(UPPER_BOUND_NAMES, nodes, adjacency);
+        CandidatePool pool = available, rest = used;
+        rest.moveAll(pool);
+        ForbiddenMask prefixForbidden = forbidden;
+        int prefixValue = current_solution, prefixRemaining = remaining_weight;
+        int bound = allBounds.evaluate(prefixValue, pool, prefixForbidden, prefixRemaining);
+        for (size_t depth = solution.size(); depth > fromDepth; depth--) {
+            int left = solution[depth - 1];
+            prefixForbidden.pop();
+            prefixValue -= nodes[left].value;
+            prefixRemaining += nodes[left].weight;
+            bound = max(bound, allBounds.evaluate(prefixValue, pool, prefixForbidden, prefixRemaining));
+            pool.insert(left);
         }
-        auto test = string2node.find(nomeu);
-        if (test == string2node.end()) {
-            cout << "ERROR: Unknown node: " << nomeu << endl;
-            exit(0);
-        } else u = string2node[nomeu];
+        return bound;
+    }
 
-        test = string2node.find(nomev);
-        if (test == string2node.end()) {
-            cout << "ERROR: Unknown node: " << nomev << endl;
-            exit(0);
-        } else v = string2node[nomev];
-        a = g.addEdge(u, v);
+    // Save the state.
+    SearchSnapshot snapshot() const {
+        SearchSnapshot saved = {available, used, solution, clean_backtrack, pathGate};
+        return saved;
     }
 
-    // if there exists some node without pre-defined position,
-    // generate all node positions
-    for (NodeIt v(g); v != INVALID; ++v) {
-        if (posx[v] == DBL_MAX || posy[v] == DBL_MAX) {
-            ListGraph t;
-            EdgeValueMap temp(t);
-            GenerateVertexPositions(g, temp, posx, posy);
-            break;
+    // Restore a saved state.
+    void restore(const SearchSnapshot &saved) {
+        while (!solution.empty()) {
+            remaining_weight += nodes[solution.back()].weight;
+            solution.pop_back();
+            forbidden.pop();
+        }
+        current_solution = 0;
+        available = saved.available;
+        used = saved.used;
+        for (int rank : saved.solution) {
+            solution.push_back(rank);
+            forbidden.push(adjacency.row(rank));
+            remaining_weight -= nodes[rank].weight;
+            current_solution += nodes[rank].value;
         }
+        clean_backtrack = saved.clean_backtrack;
+        pathGate = saved.pathGate;
+        stateGate = INT32_MAX;
     }
-    ifile.close();
-    return (true);
-}
+};
+
+/*
+ * Work-stealing pool running a fixed list of tasks. Tasks are dealt round-robin to per-thread deques, so every thread
+ * starts with the first ones; each thread takes tasks from the front of its own deque and, when it is empty, steals
+ * from the back of the others.
+ */
+class WorkStealingPool {
+private:
+    struct WorkQueue {
+        mutex lock;
+        deque<int> tasks;
+    };
+    vector<unique_ptr<WorkQueue>> queues;
+
+    bool take(int worker, int &task) {
+        int numberOfQueues = static_cast<int>(queues.size());
+        for (int i = 0; i < numberOfQueues; i++) {
+            WorkQueue &queue = *queues[(worker + i) % numberOfQueues];
+            lock_guard<mutex> guard(queue.lock);
+            if (queue.tasks.empty()) {
+                continue;
+            }
+            if (i == 0) {
+                task = queue.tasks.front();
+                queue.tasks.pop_front();
+            } else {
+                task = queue.tasks.back();
+                queue.tasks.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+
+public:
+    WorkStealingPool(int numberOfThreads, int numberOfTasks) {
+        for (int i = 0; i < numberOfThreads; i++) {
+            queues.push_back(unique_ptr<WorkQueue>(new WorkQueue));
+        }
+        for (int task = 0; task < numberOfTasks; task++) {
+            queues[task % numberOfThreads]->tasks.push_back(task);
+        }
+    }
+
+    // Run work(worker, task) for every task and wait until all are done.
+    void run(const function<void(int, int)> &work) {
+        vector<thread> threads;
+        for (int worker = 0; worker < static_cast<int>(queues.size()); worker++) {
+            threads.push_back(thread([this, &work, worker]() {
+                int task;
+                while (take(worker, task)) {
+                    work(worker, task);
+                }
+            }));
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+    }
+};
+
+/*
+ * Time and node limits of the search. The time is measured from the construction.
+ */
+class SearchLimits {
+private:
+    chrono::steady_clock::time_point start;
+    double timeLimit;
+    long long nodeLimit;
+
+public:
+    SearchLimits(const SearchOptions &options)
+            : start(chrono::steady_clock::now()), timeLimit(options.timeLimit), nodeLimit(options.nodeLimit) {}
+
+    // Seconds since the search started.
+    double elapsed() const {
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Return true if the search must stop after inserting 'nodes' nodes.
+    bool reached(long long nodes) const {
+        return (nodeLimit > 0 && nodes >= nodeLimit) || (timeLimit > 0 && elapsed() >= timeLimit);
+    }
+};
+
+/*
+ * Reports the improvements of the best solution to options.onIncumbent, in increasing order of value even when they
+ * are found by several threads.
+ */
+class IncumbentStream {
+private:
+    const function<void(int, int, double)> &onIncumbent;
+    const SearchLimits &limits;
+    mutex lock;
+    int reported = 0;
+
+public:
+    IncumbentStream(const SearchOptions &options, const SearchLimits &searchLimits)
+            : onIncumbent(options.onIncumbent), limits(searchLimits) {}
+
+    void improve(int value, int weight) {
+        if (!onIncumbent) {
+            return;
+        }
+        lock_guard<mutex> guard(lock);
+        if (value > reported) {
+            reported = value;
+            onIncumbent(value, weight, limits.elapsed());
+        }
+    }
+};
 
 set<Node>
 max_ind_set(const ListGraph &g, const NodeIntMap &weight, const NodeIntMap &value, int Capacity);
 
+set<Node>
+max_ind_set(const ListGraph &g, const NodeIntMap &weight, const NodeIntMap &value, int Capacity,
+            const SearchOptions &options, SearchStatistics &statistics);
+
+set<Node> parallel_max_ind_set(const vector<RankedNode> &nodes, const BitAdjacencyMatrix &adjacency, int min_weigth,
+                               int Capacity, const SearchOptions &options, const SearchLimits &limits,
+                               IncumbentStream &incumbents, SearchStatistics &statistics);
+
+set<Node>
+reduced_max_ind_set(const ListGraph &g, const NodeIntMap &weight, const NodeIntMap &value, int Capacity,
+                    const SearchOptions &options, SearchStatistics &statistics);
+
+// Print an improvement of the best solution as a single line, to be followed by other programs while the search runs.
+void PrintIncumbent(int value, int weight, double seconds) {
+    cout << "INCUMBENT time=" << seconds << " value=" << value << " weight=" << weight << endl;
+}
+
+// Parse a search option given in the command line. Return false if it is not valid.
+bool ParseSearchOption(const string &argument, SearchOptions &options) {
+    const string boundPrefix = "--bound=";
+    if (argument.compare(0, boundPrefix.size(), boundPrefix) == 0) {
+        options.bounds.clear();
+        istringstream names(argument.substr(boundPrefix.size()));
+        string name;
+        while (getline(names, name, ',')) {
+            if (find(UPPER_BOUND_NAMES.begin(), UPPER_BOUND_NAMES.end(), name) == UPPER_BOUND_NAMES.end()) {
+                return false;
+            }
+            options.bounds.push_back(name);
+        }
+        return !options.bounds.empty();
+    }
+    const string threadsPrefix = "--threads=", splitDepthPrefix = "--split-depth=";
+    if (argument.compare(0, threadsPrefix.size(), threadsPrefix) == 0) {
+        options.threads = StringToInt(argument.substr(threadsPrefix.size()));
+        return options.threads >= 1;
+    }
+    if (argument.compare(0, splitDepthPrefix.size(), splitDepthPrefix) == 0) {
+        options.splitDepth = StringToInt(argument.substr(splitDepthPrefix.size()));
+        return options.splitDepth >= 1;
+    }
+    const string timeLimitPrefix = "--time-limit=", nodeLimitPrefix = "--node-limit=";
+    if (argument.compare(0, timeLimitPrefix.size(), timeLimitPrefix) == 0) {
+        options.timeLimit = StringToDouble(argument.substr(timeLimitPrefix.size()));
+        return options.timeLimit > 0;
+    }
+    if (argument.compare(0, nodeLimitPrefix.size(), nodeLimitPrefix) == 0) {
+        istringstream(argument.substr(nodeLimitPrefix.size())) >> options.nodeLimit;
+        return options.nodeLimit > 0;
+    }
+    if (argument == "--incumbents") {
+        options.onIncumbent = PrintIncumbent;
+        return true;
+    }
+    if (argument == "--reduce") {
+        options.reduce = true;
+        return true;
+    }
+    return false;
+}
+
 
 bool isSetIndependent(ListGraph &g, const set<Node> &indSet) {
 
@@ -349,16 +942,31 @@ int main(int argc, char *argv[]) {
     NodePosMap posx(g), posy(g);
     string filename;
     int C;
+    SearchOptions options;
+    SearchStatistics statistics;
 
     // uncomment one of these lines to change default pdf reader, or insert new one
     //set_pdfreader("open");    // pdf reader for Mac OS X
     //set_pdfreader("xpdf");    // pdf reader for Linux
     set_pdfreader("evince");  // pdf reader for Linux
 
-    if (argc != 2) {
-        cout << endl << "Usage: " << argv[0] << " <graph_filename>" << endl << endl <<
+    bool validOptions = true;
+    for (int i = 2; i < argc; i++) {
+        validOptions = validOptions && ParseSearchOption(argv[i], options);
+    }
+    if (argc < 2 || !validOptions) {
+        cout << endl << "Usage: " << argv[0] << " <graph_filename> [options]" << endl << endl <<
+             "Options: --bound=<b1>[,<b2>...]  bounds evaluated in order to prune the search," << endl <<
+             "                                 among dantzig (default), knapsack, mt and clique" << endl <<
+             "         --threads=<n>           solve in parallel with n threads (default 1)" << endl <<
+             "         --split-depth=<k>       nodes fixed to split the tree among the threads (default 2)" << endl <<
+             "         --time-limit=<s>        stop after s seconds with the best solution found" << endl <<
+             "         --node-limit=<n>        stop after inserting n nodes with the best solution found" << endl <<
+             "         --incumbents            print a INCUMBENT line for each better solution found" << endl <<
+             "         --reduce                remove dominated nodes and solve each connected component apart" << endl << endl <<
              "Example: " << argv[0] << " gr_7" << endl <<
-             "         " << argv[0] << " gr_70" << endl << endl;
+             "         " << argv[0] << " gr_70 --bound=dantzig,clique" << endl <<
+             "         " << argv[0] << " gr_100 --time-limit=10 --incumbents" << endl << endl;
         exit(0);
     } else if (!FileExists(argv[1])) {
         cout << "File " << argv[1] << " does not exist." << endl;
@@ -397,7 +1005,28 @@ int main(int argc, char *argv[]) {
 
     cout << "Graph file: " << filename << "\n\n";
 
-    auto independentSet = max_ind_set(g, weight, value, C);
+    auto independentSet = max_ind_set(g, weight, value, C, options, statistics);
+
+    if (options.reduce) {
+        cout << "Reductions\n";
+        cout << "Removed nodes: " << statistics.removedNodes << endl;
+        cout << "Components: " << statistics.components << endl;
+        cout << "Nodes left to the search: " << statistics.searchedNodes << endl;
+        cout << "\n==============================================================\n\n";
+    }
+
+    cout << "Search statistics\n";
+    cout << "Backtracks: " << statistics.backtracks << endl;
+    cout << "Nodes: " << statistics.nodes << endl;
+    cout << "Time: " << statistics.seconds << "s" << endl;
+    if (!statistics.optimal) {
+        cout << "Search stopped at a limit - Upper bound " << statistics.upperBound << endl;
+    }
+    for (auto &bound: statistics.bounds) {
+        cout << "Bound " << bound.name << " - Evaluations " << bound.evaluations << " - Pruned " << bound.pruned
+             << endl;
+    }
+    cout << "\n==============================================================\n\n";
 
     cout << "Independent set has vertices:" << endl;
     for (auto v: independentSet)
@@ -435,104 +1064,727 @@ int main(int argc, char *argv[]) {
 // O código a seguir é apenas um exemplo de uma solução trivial
 set<Node>
 max_ind_set(const ListGraph &g, const NodeIntMap &weight, const NodeIntMap &value, int Capacity) {
+    SearchOptions options;
+    SearchStatistics statistics;
+    return max_ind_set(g, weight, value, Capacity, options, statistics);
+}
+
+set<Node>
+max_ind_set(const ListGraph &g, const NodeIntMap &weight, const NodeIntMap &value, int Capacity,
+            const SearchOptions &options, SearchStatistics &statistics) {
+    if (options.reduce) {
+        return reduced_max_ind_set(g, weight, value, Capacity, options, statistics);
+    }
+    SearchLimits limits(options);
+    IncumbentStream incumbents(options, limits);
     // Initialize variable in empty solution state.
-    int max_solution = 0, remaining_weight = Capacity, current_solution = 0;
-    OrderedLinkedNodeList available, solution, used;
+    int max_solution = 0;
     set<Node> independentSet;
 
-    int numberOfNodes = 0;
     int min_weigth = INT32_MAX;
-    // Add all nodes to the availability list that is ordered by valuePerWeight.
+    // Rank all nodes once by valuePerWeight.
+    vector<RankedNode> nodes;
     for (NodeIt v(g); v != INVALID; ++v) {
-        ListNode *listNode = new ListNode;
-        listNode->data = v;
-        listNode->weight = weight[v];
-        listNode->value = value[v];
-        listNode->valuePerWeight = (float) listNode->value / (float) listNode->weight;
-        if (listNode->weight < min_weigth) {
-            min_weigth = listNode->weight;
+        RankedNode rankedNode;
+        rankedNode.data = v;
+        rankedNode.weight = weight[v];
+        rankedNode.value = value[v];
+        rankedNode.valuePerWeight = (float) rankedNode.value / (float) rankedNode.weight;
+        if (rankedNode.weight < min_weigth) {
+            min_weigth = rankedNode.weight;
         }
-        available.insertOrdered(listNode);
-        numberOfNodes++;
+        nodes.push_back(rankedNode);
+    }
+    sort(nodes.begin(), nodes.end(), rankedBefore);
+    int numberOfNodes = static_cast<int>(nodes.size());
+
+    // Pack the edges in a bit matrix indexed by rank, the solution keeps the union of its neighbourhoods so checking
+    // if a candidate keeps it independent is a single bit test.
+    vector<int> position(static_cast<size_t>(g.maxNodeId() + 1), 0);
+    for (int rank = 0; rank < numberOfNodes; rank++) {
+        position[lemon::ListGraph::id(nodes[rank].data)] = rank;
     }
+    BitAdjacencyMatrix adjacency(g, position);
 
-    // Add all edges to a matrix to easy quick access.
-    vector<vector<int>> edges(static_cast<unsigned long>(numberOfNodes), vector<int>(
-            static_cast<unsigned long>(numberOfNodes)));
-    for (EdgeIt e(g); e != INVALID; ++e) {
-        Node v = g.v(e);
-        Node u = g.u(e);
-        edges[lemon::ListGraph::id(v)][lemon::ListGraph::id(u)] = 1;
-        edges[lemon::ListGraph::id(u)][lemon::ListGraph::id(v)] = 1;
+    if (options.threads > 1) {
+        return parallel_max_ind_set(nodes, adjacency, min_weigth, Capacity, options, limits, incumbents, statistics);
     }
 
-    // Initialize the backtrack.
+    // All nodes start available. The solution is a stack of ranks, in the order they were inserted.
+    SearchState state(nodes, adjacency, options.bounds, Capacity);
+    for (int rank = 0; rank < numberOfNodes; rank++) {
+        state.available.insert(rank);
+    }
 
-    // clean_backtrack stores the 'primary' node in the solution, the one that was the last in the solution when
-    // the used list was cleared the last time, once the solution bottom is the same as clean_backtrack once again,
-    // all the possibilities with this partial solution including this node has been fulfilled and the 'used' list
-    // is restored as available.
-    ListNode *clean_backtrack = nullptr;
     // Continue in the loop while there's available nodes to be inserted in the solution.
-    while (!available.empty()) {
+    while (!state.available.empty()) {
         // Get a candidate for inserting. And iterates to the next ones until the end or it is discarted in the
         // estimative or the remaining_weigth available is smaller the the ligther node.
-        ListNode *candidate = available.peak();
-        while (candidate != nullptr &&
-               current_solution + available.estimate(remaining_weight) > max_solution &&
-               remaining_weight >= min_weigth) {
-            ListNode *next = candidate->next;
-            if (solution.canInsertInSolution(candidate, g, edges, remaining_weight)) {
-                solution.insert(available.remove(candidate));
-                remaining_weight -= candidate->weight;
-                current_solution += candidate->value;
+        int candidate = state.available.first();
+        while (candidate != CandidatePool::NONE && state.promising(max_solution) &&
+               state.remaining_weight >= min_weigth) {
+            int next = state.available.next(candidate);
+            if (state.fits(candidate)) {
+                state.insert(candidate);
             }
             candidate = next;
         }
 
         // If the solution found is better then the best known update the best known.
-        if (current_solution >= max_solution) {
-            max_solution = current_solution;
-            independentSet = solution.toSet();
+        if (state.current_solution >= max_solution) {
+            if (state.current_solution > max_solution) {
+                incumbents.improve(state.current_solution, Capacity - state.remaining_weight);
+            }
+            max_solution = state.current_solution;
+            independentSet = toSet(state.solution, nodes);
         }
 
-        // If matches the condition described above backtracks restoring available list from used.
-        bool backtrack_cleared = false;
-        if (clean_backtrack == solution.peakBottom()) {
-            // If at this time the solution is empty there's no other viable solution candidate so it returns.
-            if (solution.empty()) {
-                return independentSet;
+        if (!state.backtrack()) {
+            break;
+        }
+        // Stop with the best solution found if the search is not over but a limit was reached.
+        if (!state.available.empty() && limits.reached(state.inserted)) {
+            statistics.optimal = false;
+            break;
+        }
+    }
+
+    statistics.backtracks += state.backtracks;
+    statistics.nodes += state.inserted;
+    statistics.seconds = limits.elapsed();
+    statistics.upperBound = statistics.optimal ? max_solution : max(state.openUpperBound(0), max_solution);
+    state.bounds.report(statistics.bounds);
+    return independentSet;
+}
+
+// Incumbent shared by the workers, packed as (value, task) in a single word so it can be updated atomically. Between
+// equal values the one found in the earlier task is the larger key.
+uint64_t IncumbentKey(int value, int task) {
+    return (static_cast<uint64_t>(value) << 32) | (UINT32_MAX - static_cast<uint32_t>(task));
+}
+
+// Best value a subtree of 'task' must exceed not to be pruned by the shared incumbent. A subtree that can only tie
+// with the incumbent is kept if the incumbent comes from a later task, as the earlier solution wins the tie.
+int IncumbentThreshold(uint64_t key, int task) {
+    int value = static_cast<int>(key >> 32);
+    int incumbentTask = static_cast<int>(UINT32_MAX - static_cast<uint32_t>(key & UINT32_MAX));
+    return incumbentTask <= task ? value : value - 1;
+}
+
+/*
+ * Something that happened in the search that decides the result of the sequential algorithm: a solution formed by
+ * inserting a node, or the search stopping because the available pool became empty.
+ */
+struct SearchEvent {
+    bool stops;
+    int value;
+    int gate;
+    vector<int> solution;
+};
+
+/*
+ * Item of the search tree split in subproblems, in the order the sequential algorithm visits them: an event found
+ * while splitting the tree or a subproblem (task) to be solved by the workers.
+ */
+struct SearchItem {
+    bool isTask;
+    SearchEvent event;
+    int task;
+};
+
+/*
+ * Events of a subproblem that may decide the result, in the order they were found: the solutions with the best value
+ * found in the subproblem and every stop of the search.
+ */
+struct SubproblemResult {
+    int best = -1;
+    vector<SearchEvent> events;
+    // Upper bound on the part of the subproblem that was not searched because a limit was reached.
+    int open = INT32_MIN;
+
+    void addSolution(const SearchState &state) {
+        if (state.current_solution < best) {
+            return;
+        }
+        if (state.current_solution > best) {
+            best = state.current_solution;
+            auto stops = remove_if(events.begin(), events.end(), [](const SearchEvent &e) { return !e.stops; });
+            events.erase(stops, events.end());
+        }
+        SearchEvent event = {false, state.current_solution, state.gate(), state.solution};
+        events.push_back(event);
+    }
+
+    void addStop(int gate) {
+        SearchEvent event = {true, 0, gate, vector<int>()};
+        events.push_back(event);
+    }
+};
+
+// Run the sequential algorithm without pruning until 'splitDepth' nodes are in the solution. Each of these states is
+// saved as a subproblem, whose subtree is left to the workers, and the search backtracks as if it had been explored.
+void split_search(SearchState &state, int min_weigth, int splitDepth, vector<SearchItem> &items,
+                  vector<SearchSnapshot> &subproblems) {
+    SearchItem item;
+    item.isTask = false;
+    item.task = -1;
+    int gate = INT32_MAX;
+    while (true) {
+        // The sequential algorithm stops when no node is available, even if the solution is not empty.
+        if (state.available.empty()) {
+            if (state.solution.empty()) {
+                return;
             }
-            // Restore the clean_backtrack to the empty state and merge used and available list as available.
-            clean_backtrack = nullptr;
-            while (!available.empty()) {
-                used.insertOrdered(available.top());
+            item.event = {true, 0, gate, vector<int>()};
+            items.push_back(item);
+        }
+        // Nothing is pruned here, the bounds only give the gate, so they are evaluated once in each state that
+        // gets a node inserted.
+        int candidate = state.available.first();
+        while (candidate != CandidatePool::NONE && state.remaining_weight >= min_weigth) {
+            int next = state.available.next(candidate);
+            if (state.fits(candidate)) {
+                state.evaluateGate();
+                state.insert(candidate);
+                item.event = {false, state.current_solution, state.gate(), state.solution};
+                items.push_back(item);
+                if (static_cast<int>(state.solution.size()) == splitDepth) {
+                    SearchItem task = item;
+                    task.isTask = true;
+                    task.task = static_cast<int>(subproblems.size());
+                    items.push_back(task);
+                    subproblems.push_back(state.snapshot());
+                    break;
+                }
             }
-            available.copy(used);
-            used.clear();
-            backtrack_cleared = true;
+            candidate = next;
         }
+        gate = state.gate();
+        if (!state.backtrack()) {
+            return;
+        }
+    }
+}
 
-        ListNode *backtracked = solution.bottom();
-        current_solution -= backtracked->value;
-        remaining_weight += backtracked->weight;
-        if (!solution.empty()) {
-            // If used was empty set clean_backtrack.
-            if (used.empty()) {
-                clean_backtrack = solution.peakBottom();
+/*
+ * State shared by the workers: the incumbent, the nodes inserted by all of them and whether a limit was reached.
+ */
+struct SharedSearch {
+    const SearchLimits &limits;
+    IncumbentStream &incumbents;
+    atomic<uint64_t> incumbent;
+    atomic<long long> inserted;
+    atomic<bool> stopped;
+
+    SharedSearch(const SearchLimits &searchLimits, IncumbentStream &incumbentStream)
+            : limits(searchLimits), incumbents(incumbentStream), incumbent(IncumbentKey(0, INT32_MAX)), inserted(0),
+              stopped(false) {}
+};
+
+// Solve a subproblem with the sequential algorithm, until the node that defines it leaves the solution. The search
+// prunes against both the best value found in the subproblem and the incumbent shared by all the workers.
+void solve_subproblem(SearchState &state, const SearchSnapshot &subproblem, int task, int min_weigth,
+                      int Capacity, SharedSearch &shared, SubproblemResult &result) {
+    if (shared.stopped) {
+        state.restore(subproblem);
+        result.open = state.openUpperBound(subproblem.solution.size());
+        return;
+    }
+    atomic<uint64_t> &incumbent = shared.incumbent;
+    long long counted = state.inserted;
+    state.restore(subproblem);
+    size_t splitDepth = subproblem.solution.size();
+    int max_solution = 0;
+    int gate = INT32_MAX;
+    // The subproblem starts in the middle of a dive, the sequential algorithm only checks the available pool after it.
+    bool diving = true;
+    while (true) {
+        if (!diving && state.available.empty()) {
+            result.addStop(gate);
+        }
+        diving = false;
+        int candidate = state.available.first();
+        while (candidate != CandidatePool::NONE &&
+               state.promising(max(max_solution, IncumbentThreshold(incumbent.load(), task))) &&
+               state.remaining_weight >= min_weigth) {
+            int next = state.available.next(candidate);
+            if (state.fits(candidate)) {
+                state.insert(candidate);
+                result.addSolution(state);
             }
-            used.insertOrdered(backtracked);
-            // If it was not a complete backtrack, restore the nodes that were added after (valuePerWeight >) to the available list.
-            if (!backtrack_cleared) {
-                ListNode *restore = backtracked->next, *nextRestore = nullptr;
-                while (restore != nullptr) {
-                    nextRestore = restore->next;
-                    available.insertOrdered(used.remove(restore));
-                    restore = nextRestore;
+            candidate = next;
+        }
+
+        if (state.current_solution >= max_solution) {
+            max_solution = state.current_solution;
+            uint64_t key = IncumbentKey(max_solution, task);
+            uint64_t known = incumbent.load();
+            while (key > known && !incumbent.compare_exchange_weak(known, key)) {}
+            shared.incumbents.improve(max_solution, Capacity - state.remaining_weight);
+        }
+
+        gate = state.gate();
+        state.backtrack();
+        if (state.solution.size() < splitDepth) {
+            return;
+        }
+        shared.inserted += state.inserted - counted;
+        counted = state.inserted;
+        if (shared.stopped || shared.limits.reached(shared.inserted)) {
+            shared.stopped = true;
+            result.open = state.openUpperBound(splitDepth);
+            return;
+        }
+    }
+}
+
+/*
+ * Parallel version of the search. The tree is split in subproblems by fixing the first options.splitDepth nodes of
+ * the solution, and the subproblems are solved by a work-stealing pool sharing the best value found.
+ *
+ * The result is the same set the sequential search returns. That is the last solution it finds with the optimum
+ * value, which depends on the order the solutions are found and on what was pruned. The optimum value OPT is first
+ * found at the first optimal solution in the search order, and from then on the sequential search prunes against
+ * OPT, reaching exactly the states whose gate is greater than OPT. So the result is the last optimal solution with
+ * gate greater than OPT, before the search stops, or the first optimal solution if there is none. The workers never
+ * prune a subtree that could hold an earlier optimal solution, keep the gates of the solutions they find and the
+ * events are combined afterwards in the sequential order. This assumes the sequential search finds the optimum and
+ * that all values are positive, so each solution is considered as soon as its last node is inserted.
+ *
+ * If a limit is reached the workers stop and the result is the first solution with the best value found.
+ */
+set<Node> parallel_max_ind_set(const vector<RankedNode> &nodes, const BitAdjacencyMatrix &adjacency, int min_weigth,
+                               int Capacity, const SearchOptions &options, const SearchLimits &limits,
+                               IncumbentStream &incumbents, SearchStatistics &statistics) {
+    int numberOfNodes = static_cast<int>(nodes.size());
+    vector<SearchItem> items;
+    vector<SearchSnapshot> subproblems;
+    {
+        SearchState state(nodes, adjacency, options.bounds, Capacity);
+        for (int rank = 0; rank < numberOfNodes; rank++) {
+            state.available.insert(rank);
+        }
+        split_search(state, min_weigth, options.splitDepth, items, subproblems);
+        statistics.nodes += state.inserted;
+        state.bounds.report(statistics.bounds);
+    }
+
+    int numberOfTasks = static_cast<int>(subproblems.size());
+    vector<SubproblemResult> results(static_cast<size_t>(numberOfTasks));
+    vector<unique_ptr<SearchState>> states;
+    for (int worker = 0; worker < options.threads; worker++) {
+        states.push_back(unique_ptr<SearchState>(new SearchState(nodes, adjacency, options.bounds, Capacity)));
+    }
+    SharedSearch shared(limits, incumbents);
+    WorkStealingPool pool(options.threads, numberOfTasks);
+    pool.run([&](int worker, int task) {
+        solve_subproblem(*states[worker], subproblems[task], task, min_weigth, Capacity, shared, results[task]);
+    });
+    for (auto &state : states) {
+        statistics.backtracks += state->backtracks;
+        statistics.nodes += state->inserted;
+        state->bounds.report(statistics.bounds);
+    }
+    statistics.seconds = limits.elapsed();
+
+    // Put the events back in the sequential order.
+    vector<const SearchEvent *> events;
+    for (const SearchItem &item : items) {
+        if (!item.isTask) {
+            events.push_back(&item.event);
+            continue;
+        }
+        for (const SearchEvent &event : results[item.task].events) {
+            events.push_back(&event);
+        }
+    }
+
+    int optimum = 0;
+    for (const SearchEvent *event : events) {
+        if (!event->stops) {
+            optimum = max(optimum, event->value);
+        }
+    }
+    statistics.optimal = !shared.stopped;
+    statistics.upperBound = optimum;
+    for (const SubproblemResult &result : results) {
+        statistics.upperBound = max(statistics.upperBound, result.open);
+    }
+    const SearchEvent *first = nullptr, *last = nullptr;
+    for (const SearchEvent *event : events) {
+        if (first == nullptr) {
+            if (!event->stops && event->value == optimum) {
+                first = event;
+            }
+            continue;
+        }
+        if (shared.stopped) {
+            break;
+        }
+        if (event->gate <= optimum) {
+            continue;
+        }
+        if (event->stops) {
+            break;
+        }
+        if (event->value == optimum) {
+            last = event;
+        }
+    }
+    if (last == nullptr) {
+        last = first;
+    }
+    return last == nullptr ? set<Node>() : toSet(last->solution, nodes);
+}
+
+// Components with at most this many independent sets are solved by enumerating them.
+const long long ENUMERATION_BUDGET = 1 << 16;
+
+/*
+ * Best independent sets of a connected component for each total weight w up to the capacity: best[w] is the value of
+ * the best set of weight exactly w, or -1 if there is none, and bestSet[w] is that set.
+ */
+struct ComponentProfile {
+    vector<int> best;
+    vector<uint64_t> bestSet;
+};
+
+/*
+ * Enumeration of the independent sets of a connected component of at most 64 nodes, indexed from 0 so that a set is a
+ * single word. For each total weight w up to the capacity it keeps the best value of a set of weight exactly w.
+ */
+class ComponentEnumeration {
+private:
+    const vector<int> &weights, &values;
+    const vector<uint64_t> &neighbours;
+    int Capacity;
+    long long budget = ENUMERATION_BUDGET;
+
+    // Visit the set 'chosen' and its extensions by nodes from 'first' on. Return false if the budget is over.
+    bool visit(int first, uint64_t chosen, uint64_t blocked, int weight, int value) {
+        if (--budget < 0) {
+            return false;
+        }
+        if (value > profile.best[weight]) {
+            profile.best[weight] = value;
+            profile.bestSet[weight] = chosen;
+        }
+        for (int i = first; i < static_cast<int>(weights.size()); i++) {
+            if (((blocked >> i) & 1) || weight + weights[i] > Capacity) {
+                continue;
+            }
+            uint64_t node = uint64_t(1) << i;
+            if (!visit(i + 1, chosen | node, blocked | neighbours[i], weight + weights[i], value + values[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    ComponentProfile profile;
+
+    ComponentEnumeration(const vector<int> &nodeWeights, const vector<int> &nodeValues,
+                         const vector<uint64_t> &nodeNeighbours, int capacity)
+            : weights(nodeWeights), values(nodeValues), neighbours(nodeNeighbours), Capacity(capacity) {
+        profile.best.assign(static_cast<size_t>(capacity + 1), -1);
+        profile.bestSet.assign(static_cast<size_t>(capacity + 1), 0);
+    }
+
+    // Return false if the component has too many independent sets to be enumerated.
+    bool run() {
+        return visit(0, 0, 0, 0, 0);
+    }
+};
+
+// Accumulate the counters of a search in 'total'.
+void AddStatistics(const SearchStatistics &statistics, SearchStatistics &total) {
+    total.backtracks += statistics.backtracks;
+    total.nodes += statistics.nodes;
+    total.optimal = total.optimal && statistics.optimal;
+    if (total.bounds.size() != statistics.bounds.size()) {
+        total.bounds = statistics.bounds;
+        return;
+    }
+    for (size_t i = 0; i < statistics.bounds.size(); i++) {
+        total.bounds[i].evaluations += statistics.bounds[i].evaluations;
+        total.bounds[i].pruned += statistics.bounds[i].pruned;
+    }
+}
+
+/*
+ * Search preceded by reductions of the graph:
+ *  - nodes heavier than the capacity are removed;
+ *  - a node v is removed if some neighbour u dominates it: N[u] is a subset of N[v], u is not heavier and has at
+ *    least the value of v. Any solution with v stays independent and in the capacity replacing v by u;
+ *  - the nodes left are split in connected components. Components with few independent sets, such as the isolated
+ *    nodes, are enumerated and combined as a knapsack over the capacity; the other ones are solved together by the
+ *    search, once for each capacity that the enumerated components may leave to them.
+ * The solution is given by the nodes of 'g'.
+ */
+set<Node>
+reduced_max_ind_set(const ListGraph &g, const NodeIntMap &weight, const NodeIntMap &value, int Capacity,
+                    const SearchOptions &options, SearchStatistics &statistics) {
+    SearchLimits limits(options);
+    vector<Node> nodes;
+    for (NodeIt v(g); v != INVALID; ++v) {
+        nodes.push_back(v);
+    }
+    int numberOfNodes = static_cast<int>(nodes.size());
+    vector<int> position(static_cast<size_t>(g.maxNodeId() + 1), 0);
+    for (int i = 0; i < numberOfNodes; i++) {
+        position[lemon::ListGraph::id(nodes[i])] = i;
+    }
+    BitAdjacencyMatrix adjacency(g, position);
+    int words = adjacency.rowWords();
+
+    vector<uint64_t> alive(static_cast<size_t>(words), 0);
+    for (int i = 0; i < numberOfNodes; i++) {
+        if (weight[nodes[i]] <= Capacity) {
+            alive[i >> 6] |= uint64_t(1) << (i & 63);
+        }
+    }
+
+    // Return true if N[u] is a subset of N[v], among the nodes left.
+    auto closedSubset = [&](int u, int v) {
+        const uint64_t *rowU = adjacency.row(u), *rowV = adjacency.row(v);
+        for (int w = 0; w < words; w++) {
+            uint64_t closedU = rowU[w] | ((u >> 6) == w ? uint64_t(1) << (u & 63) : 0);
+            uint64_t closedV = rowV[w] | ((v >> 6) == w ? uint64_t(1) << (v & 63) : 0);
+            if (closedU & alive[w] & ~closedV) {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto dominates = [&](int u, int v) {
+        Node nodeU = nodes[u], nodeV = nodes[v];
+        if (value[nodeU] < value[nodeV] || weight[nodeU] > weight[nodeV] || !closedSubset(u, v)) {
+            return false;
+        }
+        // Equal nodes dominate each other, only the one found later is removed.
+        return u < v || value[nodeU] != value[nodeV] || weight[nodeU] != weight[nodeV] || !closedSubset(v, u);
+    };
+    // Removing a node may make another one dominated, so repeat until nothing changes.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int v = 0; v < numberOfNodes; v++) {
+            if (!((alive[v >> 6] >> (v & 63)) & 1)) {
+                continue;
+            }
+            const uint64_t *row = adjacency.row(v);
+            for (int w = 0; w < words; w++) {
+                uint64_t neighbours = row[w] & alive[w];
+                bool removed = false;
+                while (neighbours != 0 && !removed) {
+                    int u = w * 64 + __builtin_ctzll(neighbours);
+                    neighbours &= neighbours - 1;
+                    removed = dominates(u, v);
+                }
+                if (removed) {
+                    alive[v >> 6] &= ~(uint64_t(1) << (v & 63));
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Split the nodes left in connected components.
+    vector<vector<int>> components;
+    vector<uint64_t> unvisited = alive;
+    for (int start = 0; start < numberOfNodes; start++) {
+        if (!((unvisited[start >> 6] >> (start & 63)) & 1)) {
+            continue;
+        }
+        unvisited[start >> 6] &= ~(uint64_t(1) << (start & 63));
+        vector<int> component(1, start);
+        for (size_t next = 0; next < component.size(); next++) {
+            const uint64_t *row = adjacency.row(component[next]);
+            for (int w = 0; w < words; w++) {
+                uint64_t reached = row[w] & unvisited[w];
+                unvisited[w] &= ~reached;
+                while (reached != 0) {
+                    component.push_back(w * 64 + __builtin_ctzll(reached));
+                    reached &= reached - 1;
                 }
             }
         }
+        components.push_back(component);
     }
 
+    // Enumerate the small components, the other ones are left to the search.
+    vector<vector<int>> enumerated;
+    vector<ComponentProfile> profiles;
+    vector<int> searched;
+    for (const vector<int> &component : components) {
+        int size = static_cast<int>(component.size());
+        if (size <= 64) {
+            vector<int> weights, values;
+            vector<uint64_t> neighbours(static_cast<size_t>(size), 0);
+            for (int i = 0; i < size; i++) {
+                weights.push_back(weight[nodes[component[i]]]);
+                values.push_back(value[nodes[component[i]]]);
+                for (int j = 0; j < size; j++) {
+                    if (adjacency.adjacent(component[i], component[j])) {
+                        neighbours[i] |= uint64_t(1) << j;
+                    }
+                }
+            }
+            ComponentEnumeration enumeration(weights, values, neighbours, Capacity);
+            if (enumeration.run()) {
+                enumerated.push_back(component);
+                profiles.push_back(enumeration.profile);
+                continue;
+            }
+        }
+        searched.insert(searched.end(), component.begin(), component.end());
+    }
+    int numberOfNodesLeft = 0;
+    for (int w = 0; w < words; w++) {
+        numberOfNodesLeft += __builtin_popcountll(alive[w]);
+    }
+    statistics.removedNodes = numberOfNodes - numberOfNodesLeft;
+    statistics.components = static_cast<int>(components.size());
+    statistics.searchedNodes = static_cast<int>(searched.size());
+
+    // Knapsack over the enumerated components: reach[c] is the best value of a choice of one set of each component
+    // with total weight exactly c and choice[k][c] is the weight of the set of component k in it.
+    int numberOfProfiles = static_cast<int>(profiles.size());
+    vector<int> reach(static_cast<size_t>(Capacity + 1), -1);
+    reach[0] = 0;
+    vector<vector<int>> choice(static_cast<size_t>(numberOfProfiles), vector<int>(static_cast<size_t>(Capacity + 1), -1));
+    for (int k = 0; k < numberOfProfiles; k++) {
+        vector<int> weights;
+        for (int w = 0; w <= Capacity; w++) {
+            if (profiles[k].best[w] >= 0) {
+                weights.push_back(w);
+            }
+        }
+        vector<int> next(static_cast<size_t>(Capacity + 1), -1);
+        for (int c = 0; c <= Capacity; c++) {
+            if (reach[c] < 0) {
+                continue;
+            }
+            for (int w : weights) {
+                if (c + w > Capacity) {
+                    break;
+                }
+                if (reach[c] + profiles[k].best[w] > next[c + w]) {
+                    next[c + w] = reach[c] + profiles[k].best[w];
+                    choice[k][c + w] = w;
+                }
+            }
+        }
+        reach = next;
+    }
+
+    // The subgraph of the nodes left to the search.
+    ListGraph residual;
+    NodeIntMap residualWeight(residual), residualValue(residual);
+    ListGraph::NodeMap<Node> original(residual);
+    vector<Node> copies(static_cast<size_t>(numberOfNodes), INVALID);
+    for (int i : searched) {
+        copies[i] = residual.addNode();
+        residualWeight[copies[i]] = weight[nodes[i]];
+        residualValue[copies[i]] = value[nodes[i]];
+        original[copies[i]] = nodes[i];
+    }
+    for (int i : searched) {
+        for (int j : searched) {
+            if (i < j && adjacency.adjacent(i, j)) {
+                residual.addEdge(copies[i], copies[j]);
+            }
+        }
+    }
+
+    // Combine the enumerated components using weight c with the best solution of the searched ones in the capacity
+    // left. The search is only needed where the enumerated value increases, and it cannot find more than it found
+    // with a larger capacity.
+    SearchOptions residualOptions = options;
+    residualOptions.reduce = false;
+    int reported = 0;
+    int best = -1, bestCapacity = 0, residualBound = INT32_MAX, increasing = -1;
+    set<Node> bestResidual;
+    bool first = true;
+    for (int c = 0; c <= Capacity; c++) {
+        if (reach[c] <= increasing) {
+            continue;
+        }
+        increasing = reach[c];
+        if (searched.empty()) {
+            if (reach[c] > best) {
+                best = reach[c];
+                bestCapacity = c;
+            }
+            continue;
+        }
+        if (best >= 0 && reach[c] + residualBound <= best) {
+            continue;
+        }
+        if (best >= 0 && limits.reached(statistics.nodes)) {
+            statistics.optimal = false;
+            break;
+        }
+        if (options.timeLimit > 0) {
+            residualOptions.timeLimit = max(options.timeLimit - limits.elapsed(), 1e-9);
+        }
+        if (options.nodeLimit > 0) {
+            residualOptions.nodeLimit = max(options.nodeLimit - statistics.nodes, 1LL);
+        }
+        int offset = reach[c], offsetWeight = c;
+        if (options.onIncumbent) {
+            residualOptions.onIncumbent = [&, offset, offsetWeight](int residualValue, int residualWeightUsed, double) {
+                if (offset + residualValue > reported) {
+                    reported = offset + residualValue;
+                    options.onIncumbent(reported, offsetWeight + residualWeightUsed, limits.elapsed());
+                }
+            };
+        }
+        SearchStatistics residualStatistics;
+        set<Node> solution = max_ind_set(residual, residualWeight, residualValue, Capacity - c, residualOptions,
+                                         residualStatistics);
+        AddStatistics(residualStatistics, statistics);
+        int solutionValue = 0;
+        for (Node v : solution) {
+            solutionValue += residualValue[v];
+        }
+        if (first) {
+            // Bound of the whole problem: the enumerated components and the searched ones with all the capacity.
+            int enumeratedBest = *max_element(reach.begin(), reach.end());
+            statistics.upperBound = enumeratedBest + residualStatistics.upperBound;
+            first = false;
+        }
+        residualBound = residualStatistics.optimal ? solutionValue : residualStatistics.upperBound;
+        if (reach[c] + solutionValue > best) {
+            best = reach[c] + solutionValue;
+            bestCapacity = c;
+            bestResidual = solution;
+        }
+    }
+
+    set<Node> independentSet;
+    for (Node v : bestResidual) {
+        independentSet.insert(original[v]);
+    }
+    for (int k = numberOfProfiles - 1, c = bestCapacity; k >= 0; k--) {
+        int w = choice[k][c];
+        for (int i = 0; i < static_cast<int>(enumerated[k].size()); i++) {
+            if ((profiles[k].bestSet[w] >> i) & 1) {
+                independentSet.insert(nodes[enumerated[k][i]]);
+            }
+        }
+        c -= w;
+    }
+    if (searched.empty()) {
+        statistics.upperBound = best;
+        if (options.onIncumbent && best > 0) {
+            options.onIncumbent(best, bestCapacity, limits.elapsed());
+        }
+    } else if (statistics.optimal) {
+        statistics.upperBound = best;
+    }
+    statistics.seconds = limits.elapsed();
     return independentSet;
 }
@@ -2,16 +2,24 @@
 #include "myutils.h"
 #include <iostream> 
 #include <fstream> 
+#include <climits>
 #include <cstdlib>
 #include <cstring>
 #include<lemon/math.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "mygraphlib.h"
 
-#if __cplusplus >= 201103L
-#include <unordered_map>
-#else
-#include <tr1/unordered_map>
-#endif
 using namespace std;
 
 
@@ -27,6 +35,179 @@ void PulaBrancoComentario(ifstream &ifile)
   }
 }
 
+// ==============================================================
+// GraphFileTokenizer
+
+static inline bool IsBlank(char c)
+{ return(c==' ' || c=='\t' || c=='\r' || c=='\n' || c=='\v' || c=='\f'); }
+
+static inline bool IsLineBlank(char c)
+{ return(c==' ' || c=='\t' || c=='\r' || c=='\v' || c=='\f'); }
+
+bool GraphFileTokenizer::Open(string filename)
+{
+  ifstream ifile(filename.c_str(), ios::in | ios::binary);
+  if (!ifile) return(false);
+  ifile.seekg(0,ios::end);
+  streamoff size = ifile.tellg();
+  if (size<0) return(false);
+  ifile.seekg(0,ios::beg);
+  buffer.resize((size_t) size + 1);
+  if (size>0 && !ifile.read(&buffer[0],size)) return(false);
+  buffer[(size_t) size] = '\0'; // the scanning stops at this sentinel
+  pos = 0;
+  names.clear();  nnames = 0;
+  return(true);
+}
+
+void GraphFileTokenizer::SkipComments()
+{
+  while (true) {
+    while (IsBlank(buffer[pos])) pos++;
+    if (buffer[pos]!='#') return;
+    while (buffer[pos]!='\n' && buffer[pos]!='\0') pos++;
+  }
+}
+
+bool GraphFileTokenizer::NextToken(const char *&begin,const char *&end)
+{
+  while (IsBlank(buffer[pos])) pos++;
+  if (buffer[pos]=='\0') return(false);
+  begin = &buffer[pos];
+  while (!IsBlank(buffer[pos]) && buffer[pos]!='\0') pos++;
+  end = &buffer[pos];
+  return(true);
+}
+
+bool GraphFileTokenizer::NextTokenInLine(const char *&begin,const char *&end)
+{
+  while (IsLineBlank(buffer[pos])) pos++;
+  if (buffer[pos]=='\n' || buffer[pos]=='\0') return(false);
+  return(NextToken(begin,end));
+}
+
+bool GraphFileTokenizer::NextLine()
+{
+  while (buffer[pos]!='\n' && buffer[pos]!='\0') pos++;
+  while (buffer[pos]!='\0') {
+    size_t line = ++pos;
+    while (IsLineBlank(buffer[pos])) pos++;
+    if (buffer[pos]!='\n' && buffer[pos]!='\0') { pos = line; return(true); }
+  }
+  return(false);
+}
+
+bool GraphFileTokenizer::ReadInt(int &x)
+{ const char *begin,*end;
+  if (!NextToken(begin,end)) return(false);
+  return(ParseInt(begin,end,x));
+}
+
+bool GraphFileTokenizer::ReadDouble(double &x)
+{ const char *begin,*end;
+  if (!NextToken(begin,end)) return(false);
+  return(ParseDouble(begin,end,x));
+}
+
+bool GraphFileTokenizer::ParseInt(const char *begin,const char *end,int &x)
+{
+  const char *p = begin;
+  bool negative = false;
+  long long v = 0, limit;
+  if (p<end && (*p=='-' || *p=='+')) { negative = (*p=='-'); p++; }
+  limit = negative ? -(long long) INT_MIN : INT_MAX;
+  const char *digits = p;
+  for (; p<end && *p>='0' && *p<='9'; p++) {
+    if (v > (limit-(*p-'0'))/10) return(false); // the value does not fit in an int
+    v = v*10 + (*p-'0');
+  }
+  x = (int) (negative ? -v : v);
+  return(p>digits && p==end);
+}
+
+bool GraphFileTokenizer::ParseDouble(const char *begin,const char *end,double &x)
+{
+  static const double pow10[] = {1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+				 1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+  const char *p = begin;
+  bool negative = false, digits = false;
+  uint64_t mantissa = 0;
+  int significant = 0, scale = 0; // the number is mantissa / 10^scale
+  if (p<end && (*p=='-' || *p=='+')) { negative = (*p=='-'); p++; }
+  for (; p<end && *p>='0' && *p<='9'; p++) {
+    digits = true;  mantissa = mantissa*10 + (*p-'0');  if (mantissa) significant++; }
+  if (p<end && *p=='.')
+    for (p++; p<end && *p>='0' && *p<='9'; p++) {
+      digits = true;  mantissa = mantissa*10 + (*p-'0');  if (mantissa) significant++;  scale++; }
+  if (!digits || p!=end || significant>15 || scale>22) {
+    // Exponents, long mantissas and anything else are left to strtod, that
+    // stops at the blank or at the sentinel after the token.
+    char *stop;
+    x = strtod(begin,&stop);
+    if (stop==begin) x = 0.0;
+    return(stop==end);
+  }
+  // Both mantissa and 10^scale are exact doubles, so the division is
+  // correctly rounded and gives the same value as strtod.
+  x = (double) mantissa / pow10[scale];
+  if (negative) x = -x;
+  return(true);
+}
+
+uint32_t GraphFileTokenizer::Hash(const char *begin,const char *end)
+{ uint32_t h = 2166136261u; // FNV-1a
+  for (const char *p=begin; p<end; p++) { h ^= (unsigned char) *p;  h *= 16777619u; }
+  return(h);
+}
+
+void GraphFileTokenizer::RehashNames(size_t capacity)
+{
+  vector<NameEntry> old;
+  old.swap(names);
+  NameEntry empty = {NULL,0,0,-1};
+  names.assign(capacity,empty);
+  for (size_t i=0;i<old.size();i++) {
+    if (old[i].name==NULL) continue;
+    size_t j = old[i].hash & (capacity-1);
+    while (names[j].name!=NULL) j = (j+1) & (capacity-1);
+    names[j] = old[i];
+  }
+}
+
+void GraphFileTokenizer::ReserveNames(int n)
+{ size_t capacity = 16;
+  while (capacity < 2*(size_t) n) capacity *= 2;
+  if (capacity > names.size()) RehashNames(capacity);
+}
+
+bool GraphFileTokenizer::AddName(const char *begin,const char *end,int index)
+{
+  if (2*(nnames+1) > names.size()) RehashNames(names.empty() ? 16 : 2*names.size());
+  uint32_t h = Hash(begin,end), length = (uint32_t) (end-begin);
+  size_t mask = names.size()-1;
+  for (size_t i=h & mask; ; i=(i+1) & mask) {
+    NameEntry &entry = names[i];
+    if (entry.name==NULL) {
+      entry.name = begin;  entry.length = length;  entry.hash = h;  entry.index = index;
+      nnames++;
+      return(true);
+    }
+    if (entry.hash==h && entry.length==length && memcmp(entry.name,begin,length)==0) return(false);
+  }
+}
+
+int GraphFileTokenizer::FindName(const char *begin,const char *end) const
+{
+  if (names.empty()) return(-1);
+  uint32_t h = Hash(begin,end), length = (uint32_t) (end-begin);
+  size_t mask = names.size()-1;
+  for (size_t i=h & mask; names[i].name!=NULL; i=(i+1) & mask) {
+    const NameEntry &entry = names[i];
+    if (entry.hash==h && entry.length==length && memcmp(entry.name,begin,length)==0) return(entry.index);
+  }
+  return(-1);
+}
+
 bool WriteListGraphGraphviz(ListGraph &g,
 		   NodeStringMap &vname, // vertex names
 		   EdgeStringMap &ename,  // edge names
@@ -87,45 +268,42 @@ int gr_busca_padrao(char *texto,char *busca)
 }
 
 
-bool ReadEuclideanListGraph(string filename,
-			    ListGraph &g,
-			    NodeStringMap & vname,
-			    EdgeValueMap  & custo,
-			    NodePosMap    & posx,
-			    NodePosMap    & posy)
+bool ReadEuclideanGraph(string filename,EuclideanGraph &eg)
 {
   int i,n,m;
-  Node nu,nv;
-  Edge a;
-  char nomev[100];
-  Node v;
+  const char *nomev,*endnomev;
   double px,py;
   
-  ifstream ifile;  ifile.open(filename.c_str());  if (!ifile) return(false);
-  PulaBrancoComentario(ifile);
+  GraphFileTokenizer in;  if (!in.Open(filename)) return(false);
+  in.SkipComments();
   // format: <number_of_nodes>   -1
   // The value -1 is to indicate that there is no edge/arc, as edge weights
   // are given by the euclidean distance
-  ifile >> n;    ifile >> m;
-  if (m!=-1) {
+  if (!in.ReadInt(n) || !in.ReadInt(m) || n<0 || m!=-1) {
     printf("Wrong format in the euclidean graph of file %s.\n",filename.c_str());
     return(false);
   }
+  eg.Reserve(n);
   for (i=0;i<n;i++) {
-    ifile >> nomev;  ifile >> px; ifile >> py;
-    v = g.addNode();    vname[v] = nomev;    posx[v] = px;    posy[v] = py;
+    if (!in.NextToken(nomev,endnomev)) {cout<<"Reached unexpected end of file "<<filename<<".\n";return(false);}
+    if (!in.ReadDouble(px) || !in.ReadDouble(py))
+      {cout<<"Wrong coordinates for node "<<string(nomev,endnomev)<<" in file "<<filename<<".\n";return(false);}
+    eg.AddNode(string(nomev,endnomev),px,py);
   }
+  return(true);
+}
 
-  for (NodeIt v(g); v!=INVALID; ++v) {
-    NodeIt u(g);
-    u=v;
-    for (++u; u!=INVALID; ++u) {
-      a = g.addEdge(u,v);
-      custo[a] = sqrt((posx[u]-posx[v])*(posx[u]-posx[v]) + 
-		      (posy[u]-posy[v])*(posy[u]-posy[v]));
-    }
-  }
-  ifile.close();
+bool ReadEuclideanListGraph(string filename,
+			    ListGraph &g,
+			    NodeStringMap & vname,
+			    EdgeValueMap  & custo,
+			    NodePosMap    & posx,
+			    NodePosMap    & posy)
+{
+  EuclideanGraph eg;
+  vector<Node> V;
+  if (!ReadEuclideanGraph(filename,eg)) return(false);
+  eg.BuildListGraph(g,vname,custo,posx,posy,V,false);
   return(true);
 }
 
@@ -246,64 +424,45 @@ bool ReadListDigraph(string filename,
 		     DNodePosMap     & posy,
 		     const bool dupla)
 {
-  ifstream ifile;
+  GraphFileTokenizer in;
   int i,n,m;
   double peso;
   Arc a;
-  char nomeu[100],nomev[100];
-  string STR;
-  DNode u,v;
-#if __cplusplus >= 201103L
-  std::unordered_map<string,DNode> string2node,test;
-#else
-  std::tr1::unordered_map<string,DNode> string2node;
-#endif
+  const char *nomeu,*endnomeu,*nomev,*endnomev;
+  DNode v;
 
-  ifile.open(filename.c_str());
-  if (!ifile) {cout << "File '" << filename << "' does not exist.\n"; exit(0);}
-  PulaBrancoComentario(ifile);
-  ifile >> n;    ifile >> m; // first line have number of nodes and number of arcs
-  if (m<0 || ifile.eof())
+  if (!in.Open(filename)) {cout << "File '" << filename << "' does not exist.\n"; exit(0);}
+  in.SkipComments();
+  // first line have number of nodes and number of arcs
+  if (!in.ReadInt(n) || !in.ReadInt(m) || n<0 || m<0)
     { cout<<"File "<<filename<<" is not a digraph given by arcs.\n"; exit(0);}
 
+  vector<DNode> V(n);
+  in.ReserveNames(n);
+  g.reserveNode(n);  g.reserveArc(dupla ? 2*m : m);
   for (i=0;i<n;i++) {
-    getline(ifile,STR);
-    if (ifile.eof()) {cout<<"Reached unexpected end of file "<<filename<<".\n";exit(0);}
-    while (STR=="") getline(ifile,STR);
-    {
-      string token;
-      istringstream ins; // Declare an input string stream.
-      ins.str(STR);        // Specify string to read.
-      int nt = 0;
-      while( getline(ins, token, ' ') ) {
-	// format: <node_name>  <pos_x>  <pos_y>
-	if (nt==0) {
-	  auto test = string2node.find(token);
-
-	  if (test!=string2node.end()){cout<<"ERROR: Repeated node: "<<nomev<<endl;exit(0);}
-	  v = g.addNode(); string2node[token] = v; vname[v] = token;}
-	else if (nt==1) { posx[v] = atof(token.c_str());}
-	else if (nt==2) { posy[v] = atof(token.c_str());}
-	nt++;
-      }
-    }
+    // format: <node_name>  <pos_x>  <pos_y>
+    if (!in.NextLine() || !in.NextTokenInLine(nomev,endnomev))
+      {cout<<"Reached unexpected end of file "<<filename<<".\n";exit(0);}
+    if (!in.AddName(nomev,endnomev,i))
+      {cout<<"ERROR: Repeated node: "<<string(nomev,endnomev)<<endl;exit(0);}
+    v = g.addNode();  V[i] = v;  vname[v] = string(nomev,endnomev);
+    if ((in.NextTokenInLine(nomev,endnomev) && !GraphFileTokenizer::ParseDouble(nomev,endnomev,posx[v])) ||
+	(in.NextTokenInLine(nomev,endnomev) && !GraphFileTokenizer::ParseDouble(nomev,endnomev,posy[v])))
+      { cout<<"File "<<filename<<" is not a digraph given by arcs.\n"; exit(0);}
   }
+  in.NextLine(); // what is left in the last node line is not an arc
   for (i=0;i<m;i++) {
     // format: <node_source>   <node_target>   <arc_weight>
-    ifile >> nomeu;  ifile >> nomev; ifile >> peso;
-    if (ifile.eof()) 
+    if (!in.NextToken(nomeu,endnomeu) || !in.NextToken(nomev,endnomev) || !in.ReadDouble(peso))
       {cout << "Reached unexpected end of file " <<filename << ".\n"; exit(0);}
-    auto test = string2node.find(nomeu);
-    if (test == string2node.end()) {cout<<"ERROR: Unknown node: "<<nomeu<<endl;exit(0);}
-    else u = string2node[nomeu];
-    
-    test = string2node.find(nomev);
-    if (test == string2node.end()) {cout<<"ERROR: Unknown node: "<<nomev<<endl;exit(0);}
-    else v = string2node[nomev];
-    a = g.addArc(u,v); weight[a] = peso;
-    if (dupla) {a = g.addArc(v,u);   weight[a] = peso;}
+    int u = in.FindName(nomeu,endnomeu);
+    if (u<0) {cout<<"ERROR: Unknown node: "<<string(nomeu,endnomeu)<<endl;exit(0);}
+    int w = in.FindName(nomev,endnomev);
+    if (w<0) {cout<<"ERROR: Unknown node: "<<string(nomev,endnomev)<<endl;exit(0);}
+    a = g.addArc(V[u],V[w]); weight[a] = peso;
+    if (dupla) {a = g.addArc(V[w],V[u]);   weight[a] = peso;}
   }
-  ifile.close();
   return(true);
 }
 
@@ -320,60 +479,48 @@ bool ReadListDigraph(string filename,
 
 
 // To read list of nodes in the format: <node_name>  <double1>  <double2>
-void ReadListGraphNodes(ListGraph &g,int nnodes,ifstream & ifile,
-#if __cplusplus >= 201103L
-    std::unordered_map<string,Node> & string2node,
-#else
-    std::tr1::unordered_map<string,Node> & string2node,
-#endif
-			   NodeStringMap &vname,
-			   NodePosMap  &posx,
-			   NodePosMap  &posy)
-{ string STR;  Node u,v;  string token;
+void ReadListGraphNodes(ListGraph &g,int nnodes,GraphFileTokenizer &in,
+			vector<Node> &V,
+			NodeStringMap &vname,
+			NodePosMap  &posx,
+			NodePosMap  &posy)
+{ const char *token,*endtoken;  Node v;
+  V.resize(nnodes);
+  in.ReserveNames(nnodes);
+  g.reserveNode(nnodes);
   for (int i=0;i<nnodes;i++) {
-    getline(ifile,STR);
-    if (ifile.eof()) {cout<<"Reached unexpected end of file.\n";exit(0);}
-    while (STR=="") getline(ifile,STR);
-    { istringstream ins; // Declare an input string stream.
-      ins.str(STR);        // Specify string to read.
-      for (int p=0; getline(ins, token, ' ') ; p++) {
-	if (p==0) {   // For example, to read:   node_name   posx   posy
-	  auto test = string2node.find(token);
-	  if (test!=string2node.end()){cout<<"ERROR: Repeated node: "<<token<<endl;exit(0);}
-	  v = g.addNode(); string2node[token] = v; vname[v] = token;
-	  posx[v]=DBL_MAX;  posy[v]=DBL_MAX; }
-	else if (p==1) { posx[v] = atof(token.c_str());}
-	else if (p==2) { posy[v] = atof(token.c_str());}
-      }}
-  }
-}
-
-
-void ReadListGraphEdges(ListGraph &g,int nedges,ifstream & ifile,
-#if __cplusplus >= 201103L
-			std::unordered_map<string,Node> & string2node,
-#else
-			std::tr1::unordered_map<string,Node> & string2node,
-#endif
+    // For example, to read:   node_name   posx   posy
+    if (!in.NextLine() || !in.NextTokenInLine(token,endtoken))
+      {cout<<"Reached unexpected end of file.\n";exit(0);}
+    if (!in.AddName(token,endtoken,i))
+      {cout<<"ERROR: Repeated node: "<<string(token,endtoken)<<endl;exit(0);}
+    v = g.addNode();  V[i] = v;  vname[v] = string(token,endtoken);
+    posx[v]=DBL_MAX;  posy[v]=DBL_MAX;
+    if ((in.NextTokenInLine(token,endtoken) && !GraphFileTokenizer::ParseDouble(token,endtoken,posx[v])) ||
+	(in.NextTokenInLine(token,endtoken) && !GraphFileTokenizer::ParseDouble(token,endtoken,posy[v])))
+      {cout<<"Wrong position for node "<<vname[v]<<".\n";exit(0);}
+  }
+  in.NextLine(); // what is left in the last node line is not an edge
+}
+
+
+void ReadListGraphEdges(ListGraph &g,int nedges,GraphFileTokenizer &in,
+			vector<Node> &V,
 			EdgeValueMap &weight)
 {
-  Node u,v;
   Edge a;
-  string nomeu,nomev;
+  const char *nomeu,*endnomeu,*nomev,*endnomev;
   double peso;
+  g.reserveEdge(nedges);
   for (int i=0;i<nedges;i++) {
     // format: <node_u>   <node_v>   <edge_weight>
-    ifile >> nomeu;  ifile >> nomev; ifile >> peso;
-    if (ifile.eof()) 
+    if (!in.NextToken(nomeu,endnomeu) || !in.NextToken(nomev,endnomev) || !in.ReadDouble(peso))
       {cout << "Reached unexpected end of file.\n"; exit(0);}
-    auto test = string2node.find(nomeu);
-    if (test == string2node.end()) {cout<<"ERROR: Unknown node: "<<nomeu<<endl;exit(0);}
-    else u = string2node[nomeu];
-    
-    test = string2node.find(nomev);
-    if (test == string2node.end()) {cout<<"ERROR: Unknown node: "<<nomev<<endl;exit(0);}
-    else v = string2node[nomev];
-    a = g.addEdge(u,v);
+    int u = in.FindName(nomeu,endnomeu);
+    if (u<0) {cout<<"ERROR: Unknown node: "<<string(nomeu,endnomeu)<<endl;exit(0);}
+    int v = in.FindName(nomev,endnomev);
+    if (v<0) {cout<<"ERROR: Unknown node: "<<string(nomev,endnomev)<<endl;exit(0);}
+    a = g.addEdge(V[u],V[v]);
     weight[a] = peso;
   }
 }
@@ -388,27 +535,19 @@ bool ReadListGraph2(string filename,
 		    NodePosMap& posx,
 		    NodePosMap& posy)
 {
-  ifstream ifile;
+  GraphFileTokenizer in;
   int n,m;
-  Edge a;
-  string STR;
-  Node u,v;
-#if __cplusplus >= 201103L
-  std::unordered_map<string,Node> string2node;
-#else
-  std::tr1::unordered_map<string,Node> string2node;
-#endif
-  ifile.open(filename.c_str());
-  if (!ifile) {cout << "File '" << filename << "' does not exist.\n"; exit(0);}
-  PulaBrancoComentario(ifile);
-  ifile >> n;    ifile >> m; // first line have number of nodes and number of arcs
-  if (m<0 || ifile.eof())
+  vector<Node> V;
+  if (!in.Open(filename)) {cout << "File '" << filename << "' does not exist.\n"; exit(0);}
+  in.SkipComments();
+  // first line have number of nodes and number of arcs
+  if (!in.ReadInt(n) || !in.ReadInt(m) || n<0 || m<0)
     { cout<<"File "<<filename<<" is not a digraph given by arcs.\n"; exit(0);}
 
-  // continue to read ifile, and insert information in g for the next n nodes
-  ReadListGraphNodes(g,n,ifile,string2node,vname,posx,posy);
-  // continue to read ifile, and obtain edge weights
-  ReadListGraphEdges(g,m,ifile,string2node,weight);
+  // continue to read the file, and insert information in g for the next n nodes
+  ReadListGraphNodes(g,n,in,V,vname,posx,posy);
+  // continue to read the file, and obtain edge weights
+  ReadListGraphEdges(g,m,in,V,weight);
   // if there exists some node without pre-defined position,
   // generate all node positions
   for (NodeIt v(g); v!=INVALID; ++v) {
@@ -416,7 +555,6 @@ bool ReadListGraph2(string filename,
       GenerateVertexPositions(g,weight,posx,posy);
       break;
     }}
-  ifile.close();
   return(true);
 }
 
@@ -435,6 +573,8 @@ bool ReadListGraph(string filename,
   char fname[1000];
   strcpy(fname,filename.c_str());
 
+  if (IsBinaryGraphFile(filename))
+    return(ReadListGraphBinary(filename,g,nodename,custo,posx,posy));
   ifile.open(fname);  if (!ifile) return(false);
 
   PulaBrancoComentario(ifile);
@@ -446,6 +586,284 @@ bool ReadListGraph(string filename,
   return(r);
 }
 
+bool ReadListGraph3(string filename,
+		    ListGraph &g,
+		    NodeStringMap &vname,
+		    NodeIntMap &weight,
+		    NodeIntMap &value,
+		    NodePosMap &posx,
+		    NodePosMap &posy,
+		    int &C)
+{
+  GraphFileTokenizer in;
+  int n,m;
+  Node v;
+  const char *nomeu,*endnomeu,*nomev,*endnomev;
+  if (IsBinaryGraphFile(filename)) {
+    EdgeValueMap edgeweight(g);
+    return(ReadListGraphBinary(filename,g,vname,edgeweight,posx,posy,weight,value,C));
+  }
+  if (!in.Open(filename)) {cout << "File '" << filename << "' does not exist.\n"; exit(0);}
+  in.SkipComments();
+  // first line have number of nodes, number of edges and capacity
+  if (!in.ReadInt(n) || !in.ReadInt(m) || !in.ReadInt(C) || n<0 || m<0)
+    { cout<<"File "<<filename<<" is not a graph given by edges.\n"; exit(0);}
+
+  // continue to read the file, and insert information in g for the next n nodes
+  vector<Node> V(n);
+  in.ReserveNames(n);
+  g.reserveNode(n);  g.reserveEdge(m);
+  for (int i=0;i<n;i++) {
+    // format: <node_name>  <node_weight>  <node_value>
+    if (!in.NextToken(nomev,endnomev)) {cout << "Reached unexpected end of file.\n"; exit(0);}
+    if (!in.AddName(nomev,endnomev,i))
+      {cout<<"ERROR: Repeated node: "<<string(nomev,endnomev)<<endl;exit(0);}
+    v = g.addNode();  V[i] = v;  vname[v] = string(nomev,endnomev);
+    if (!in.ReadInt(weight[v]) || !in.ReadInt(value[v]))
+      { cout<<"File "<<filename<<" is not a graph given by edges.\n"; exit(0);}
+    posx[v] = 0.0;  posy[v] = 0.0;
+  }
+
+  // continue to read the file, and obtain the edges
+  for (int i=0;i<m;i++) {
+    // format: <node_u>   <node_v>
+    if (!in.NextToken(nomeu,endnomeu) || !in.NextToken(nomev,endnomev))
+      {cout << "Reached unexpected end of file.\n"; exit(0);}
+    int u = in.FindName(nomeu,endnomeu);
+    if (u<0) {cout<<"ERROR: Unknown node: "<<string(nomeu,endnomeu)<<endl;exit(0);}
+    int w = in.FindName(nomev,endnomev);
+    if (w<0) {cout<<"ERROR: Unknown node: "<<string(nomev,endnomev)<<endl;exit(0);}
+    g.addEdge(V[u],V[w]);
+  }
+  return(true);
+}
+
+// ==============================================================
+// Binary graph files. All numbers are in the native byte order, and
+// the sections follow the header in this order:
+//   double    posx[n], posy[n], edgeweight[m]
+//   uint32_t  edgestart[n+1], edgetarget[m]   (CSR: node u has the edges
+//             {u,edgetarget[k]}, for edgestart[u] <= k < edgestart[u+1])
+//   int32_t   nodeweight[n], nodevalue[n]     (only with BINARYGRAPH_NODEWEIGHTS)
+//   uint32_t  namestart[n+1]
+//   char      names[namestart[n]]              (names are not 0-terminated)
+// The header is 48 bytes, so the doubles are aligned in the mapped file.
+#define BINARYGRAPH_MAGIC "MYGRAPHB"
+#define BINARYGRAPH_VERSION 1
+#define BINARYGRAPH_NODEWEIGHTS 1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t nnodes;
+  uint64_t nedges;
+  int64_t capacity;
+  uint64_t namesize;
+} BinaryGraphHeader;
+
+// Offsets of the sections of a binary graph file, in bytes.
+typedef struct {
+  size_t posx,posy,edgeweight,edgestart,edgetarget,nodeweight,nodevalue,namestart,names,size;
+} BinaryGraphLayout;
+
+// Return false if the counts of the header do not fit in a file of
+// filesize bytes. The counts are checked before any offset is computed, so
+// an invalid header cannot make them wrap.
+bool BinaryGraphSections(const BinaryGraphHeader &h,size_t filesize,BinaryGraphLayout &l)
+{
+  if (h.nnodes >= UINT32_MAX || h.nedges >= UINT32_MAX || h.namesize >= UINT32_MAX)
+    return(false);
+  size_t n = h.nnodes, m = h.nedges; // so the offsets below are less than 2^38
+  l.posx = sizeof(BinaryGraphHeader);
+  l.posy = l.posx + n*sizeof(double);
+  l.edgeweight = l.posy + n*sizeof(double);
+  l.edgestart = l.edgeweight + m*sizeof(double);
+  l.edgetarget = l.edgestart + (n+1)*sizeof(uint32_t);
+  l.nodeweight = l.edgetarget + m*sizeof(uint32_t);
+  l.nodevalue = l.nodeweight;
+  l.namestart = l.nodeweight;
+  if (h.flags & BINARYGRAPH_NODEWEIGHTS) {
+    l.nodevalue = l.nodeweight + n*sizeof(int32_t);
+    l.namestart = l.nodevalue + n*sizeof(int32_t);
+  }
+  l.names = l.namestart + (n+1)*sizeof(uint32_t);
+  if (l.names > filesize || h.namesize > filesize-l.names) return(false);
+  l.size = l.names + h.namesize;
+  return(l.size==filesize);
+}
+
+bool IsBinaryGraphFile(string filename)
+{
+  char magic[8];
+  ifstream ifile(filename.c_str(), ios::in | ios::binary);
+  if (!ifile.read(magic,sizeof(magic))) return(false);
+  return(memcmp(magic,BINARYGRAPH_MAGIC,sizeof(magic))==0);
+}
+
+bool WriteListGraphBinary2(string filename,
+			   ListGraph &g,
+			   NodeStringMap &vname,
+			   EdgeValueMap &weight,
+			   NodePosMap &posx,
+			   NodePosMap &posy,
+			   NodeIntMap *nodeweight,
+			   NodeIntMap *nodevalue,
+			   int capacity)
+{
+  NodeIndexMap index(g);
+  vector<Node> V;
+  for (NodeIt v(g); v!=INVALID; ++v) { index[v] = V.size(); V.push_back(v); }
+  size_t n = V.size();
+
+  // Group the edges by the index of their first end node.
+  vector<uint32_t> edgestart(n+1,0),edgetarget;
+  vector<double> edgeweight;
+  for (EdgeIt e(g); e!=INVALID; ++e) edgestart[index[g.u(e)]+1]++;
+  for (size_t i=0;i<n;i++) edgestart[i+1] += edgestart[i];
+  size_t m = edgestart[n];
+  vector<uint32_t> next(edgestart.begin(),edgestart.end()-1);
+  edgetarget.resize(m);  edgeweight.resize(m);
+  for (EdgeIt e(g); e!=INVALID; ++e) {
+    uint32_t k = next[index[g.u(e)]]++;
+    edgetarget[k] = index[g.v(e)];  edgeweight[k] = weight[e];
+  }
+
+  vector<double> px(n),py(n);
+  vector<int32_t> nw,nv;
+  vector<uint32_t> namestart(n+1,0);
+  string names;
+  for (size_t i=0;i<n;i++) {
+    px[i] = posx[V[i]];  py[i] = posy[V[i]];
+    if (nodeweight!=NULL) { nw.push_back((*nodeweight)[V[i]]); nv.push_back((*nodevalue)[V[i]]); }
+    names += vname[V[i]];  namestart[i+1] = names.size();
+  }
+
+  BinaryGraphHeader h;
+  memcpy(h.magic,BINARYGRAPH_MAGIC,sizeof(h.magic));
+  h.version = BINARYGRAPH_VERSION;
+  h.flags = (nodeweight!=NULL) ? BINARYGRAPH_NODEWEIGHTS : 0;
+  h.nnodes = n;  h.nedges = m;  h.capacity = capacity;  h.namesize = names.size();
+
+  ofstream ofile(filename.c_str(), ios::out | ios::binary | ios::trunc);
+  if (!ofile) {cout << "Could not write file '" << filename << "'.\n"; return(false);}
+  ofile.write((const char *) &h, sizeof(h));
+  ofile.write((const char *) px.data(), n*sizeof(double));
+  ofile.write((const char *) py.data(), n*sizeof(double));
+  ofile.write((const char *) edgeweight.data(), m*sizeof(double));
+  ofile.write((const char *) edgestart.data(), (n+1)*sizeof(uint32_t));
+  ofile.write((const char *) edgetarget.data(), m*sizeof(uint32_t));
+  if (nodeweight!=NULL) {
+    ofile.write((const char *) nw.data(), n*sizeof(int32_t));
+    ofile.write((const char *) nv.data(), n*sizeof(int32_t));
+  }
+  ofile.write((const char *) namestart.data(), (n+1)*sizeof(uint32_t));
+  ofile.write(names.data(), names.size());
+  return(ofile.good());
+}
+
+bool WriteListGraphBinary(string filename,
+			  ListGraph &g,
+			  NodeStringMap &vname,
+			  EdgeValueMap &weight,
+			  NodePosMap &posx,
+			  NodePosMap &posy)
+{ return(WriteListGraphBinary2(filename,g,vname,weight,posx,posy,NULL,NULL,0)); }
+
+bool WriteListGraphBinary(string filename,
+			  ListGraph &g,
+			  NodeStringMap &vname,
+			  EdgeValueMap &weight,
+			  NodePosMap &posx,
+			  NodePosMap &posy,
+			  NodeIntMap &nodeweight,
+			  NodeIntMap &nodevalue,
+			  int capacity)
+{ return(WriteListGraphBinary2(filename,g,vname,weight,posx,posy,&nodeweight,&nodevalue,capacity)); }
+
+// Map the file in memory and build g from the sections. The node weights and
+// values are only read if nodeweight is not NULL.
+bool ReadListGraphBinary2(string filename,
+			  ListGraph &g,
+			  NodeStringMap &vname,
+			  EdgeValueMap &weight,
+			  NodePosMap &posx,
+			  NodePosMap &posy,
+			  NodeIntMap *nodeweight,
+			  NodeIntMap *nodevalue,
+			  int *capacity)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd<0) {cout << "File '" << filename << "' does not exist.\n"; return(false);}
+  struct stat st;
+  if (fstat(fd,&st)!=0 || (size_t) st.st_size < sizeof(BinaryGraphHeader)) {
+    cout << "File '" << filename << "' is not a binary graph file.\n"; close(fd); return(false);}
+  size_t filesize = st.st_size;
+  void *map = mmap(NULL, filesize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map==MAP_FAILED) {cout << "Could not map file '" << filename << "'.\n"; return(false);}
+
+  const char *base = (const char *) map;
+  const BinaryGraphHeader &h = *(const BinaryGraphHeader *) base;
+  BinaryGraphLayout l;
+  bool ok = memcmp(h.magic,BINARYGRAPH_MAGIC,sizeof(h.magic))==0 && h.version==BINARYGRAPH_VERSION
+    && BinaryGraphSections(h,filesize,l);
+  if (!ok) cout << "File '" << filename << "' is not a valid binary graph file.\n";
+  else if (nodeweight!=NULL && !(h.flags & BINARYGRAPH_NODEWEIGHTS)) {
+    cout << "File '" << filename << "' has no node weights.\n";  ok = false; }
+  if (ok) {
+    size_t n = h.nnodes, m = h.nedges;
+    const double *px = (const double *) (base+l.posx), *py = (const double *) (base+l.posy),
+      *edgeweight = (const double *) (base+l.edgeweight);
+    const uint32_t *edgestart = (const uint32_t *) (base+l.edgestart),
+      *edgetarget = (const uint32_t *) (base+l.edgetarget),
+      *namestart = (const uint32_t *) (base+l.namestart);
+    const int32_t *nw = (const int32_t *) (base+l.nodeweight), *nv = (const int32_t *) (base+l.nodevalue);
+    const char *names = base+l.names;
+
+    g.reserveNode(n);  g.reserveEdge(m);
+    vector<Node> V(n);
+    for (size_t i=0;i<n;i++)
+      if (namestart[i]>namestart[i+1] || namestart[i+1]>h.namesize) {
+	cout << "File '" << filename << "' has an invalid node name.\n";  ok = false;  break; }
+    for (size_t i=0;i<n && ok;i++) {
+      Node v = g.addNode();  V[i] = v;
+      vname[v] = string(names+namestart[i], names+namestart[i+1]);
+      posx[v] = px[i];  posy[v] = py[i];
+      if (nodeweight!=NULL) { (*nodeweight)[v] = nw[i];  (*nodevalue)[v] = nv[i]; }
+    }
+    for (size_t i=0;i<n && ok;i++)
+      for (uint32_t k=edgestart[i];k<edgestart[i+1];k++) {
+	if (k>=m || edgetarget[k]>=n) {
+	  cout << "File '" << filename << "' has an invalid edge.\n";  ok = false;  break; }
+	Edge e = g.addEdge(V[i],V[edgetarget[k]]);
+	weight[e] = edgeweight[k];
+      }
+    if (capacity!=NULL) *capacity = (int) h.capacity;
+  }
+  munmap(map,filesize);
+  return(ok);
+}
+
+bool ReadListGraphBinary(string filename,
+			 ListGraph &g,
+			 NodeStringMap &vname,
+			 EdgeValueMap &weight,
+			 NodePosMap &posx,
+			 NodePosMap &posy)
+{ return(ReadListGraphBinary2(filename,g,vname,weight,posx,posy,NULL,NULL,NULL)); }
+
+bool ReadListGraphBinary(string filename,
+			 ListGraph &g,
+			 NodeStringMap &vname,
+			 EdgeValueMap &weight,
+			 NodePosMap &posx,
+			 NodePosMap &posy,
+			 NodeIntMap &nodeweight,
+			 NodeIntMap &nodevalue,
+			 int &capacity)
+{ return(ReadListGraphBinary2(filename,g,vname,weight,posx,posy,&nodeweight,&nodevalue,&capacity)); }
+
 //Generate a random complete euclidean ListGraph
 bool GenerateRandomEuclideanListDigraph(ListDigraph &g,
 			  DNodeStringMap &vname, // node name
@@ -807,6 +1225,7 @@ double MinCut(ListGraph &g, EdgeValueMap &weight, Node &s,Node &t, CutMap &cut)
 // Obtain a mininum cut for directed graphs from s to t.
 // The returned cut is given by the vector of nodes 'cut' (boolean
 // vector: nodes v in the same side of s have cut[v]=true, otherwise cut[v]=false.
+// To obtain many cuts in the same digraph, use DiMinCutSolver below.
 double DiMinCut(ListDigraph &g, ArcValueMap &weight, DNode &s,DNode &t, DCutMap &vcut)
 {
   Preflow<ListDigraph, ArcValueMap> preflow_test(g, weight, s, t); 
@@ -817,6 +1236,43 @@ double DiMinCut(ListDigraph &g, ArcValueMap &weight, DNode &s,DNode &t, DCutMap
 
 
 
+DiMinCutSolver::DiMinCutSolver(ListDigraph &g,ArcValueMap &capacity):
+  g(g), capacity(capacity), flow(g), pf(g,capacity,INVALID,INVALID)
+{
+  pf.flowMap(flow);
+  hasflow = false;
+}
+
+void DiMinCutSolver::Init(DNode s,DNode t,bool warmstart)
+{
+  pf.source(s);  pf.target(t);
+  if (warmstart && hasflow) {
+    bool feasible=true; // the previous flow must respect the new capacities
+    for (ArcIt a(g); a!=INVALID && feasible; ++a)
+      if (flow[a] > capacity[a]+MY_EPS) feasible=false;
+    if (feasible && pf.init(flow)) return;
+  }
+  pf.init();
+}
+
+double DiMinCutSolver::Run(DNode s,DNode t,DCutMap &cut,bool warmstart)
+{
+  Init(s,t,warmstart);
+  pf.startFirstPhase();
+  hasflow = true;
+  pf.minCutMap(cut);
+  return(pf.flowValue());
+}
+
+double DiMinCutSolver::MaxFlow(DNode s,DNode t,bool warmstart)
+{
+  Init(s,t,warmstart);
+  pf.startFirstPhase();
+  pf.startSecondPhase();
+  hasflow = true;
+  return(pf.flowValue());
+}
+
 /*---------------------------------------------------------------------*/
 #define MAXPOINTPOSITION 6000 /* each coordinate belongs to the
 				  interval [0..MAXPOINTPOSITION)  */
@@ -1031,16 +1487,19 @@ int ViewEuclideanListGraph(ListGraph &g,
 }
 
 // ================================================================
-int globalcounter=0;
+#ifdef ADJMAT_COUNTCOSTS
+long long globalcounter=0;
+#endif
 
 void ADJMAT_FreeNotNull(void *p){  if (p) free(p);  }
 
 // Define an adjacency matrix, so as we have a fast access for the edges of a graph,
 // given a pair of vertices. This is mainly used in the subroutine 2opt, for 
 // dense graphs.
-// The adjacency matrix is stored in a strictly triangular inferior matrix.
+// The adjacency matrix is stored in a full square matrix (both (i,j) and (j,i)).
 
-AdjacencyMatrix::AdjacencyMatrix(ListGraph &graph,EdgeValueMap &graphweight,double NonEdgValue):
+AdjacencyMatrix::AdjacencyMatrix(ListGraph &graph,EdgeValueMap &graphweight,double NonEdgValue,
+				 bool singleprecision):
   Node2Index(graph),Edge2Index(graph)
 {
   int i;
@@ -1049,15 +1508,18 @@ AdjacencyMatrix::AdjacencyMatrix(ListGraph &graph,EdgeValueMap &graphweight,doub
   weight = &graphweight;
   Nnodes = countNodes(graph); // number of nodes in the input graph
   Nedges = countEdges(graph); // number of edges in the input graph
-  Nmatrix = (Nnodes*(Nnodes-1))/2; // no. of edges/elem. in strict. triang. inf. matrix
+  Nmatrix = (size_t) Nnodes*Nnodes; // no. of elements in the square matrix
 
-  AdjMatrix = (double *) malloc(sizeof(double)*Nmatrix);
+  AdjMatrix = NULL;  AdjMatrixF = NULL;
+  if (singleprecision) AdjMatrixF = (float *) malloc(sizeof(float)*Nmatrix);
+  else AdjMatrix = (double *) malloc(sizeof(double)*Nmatrix);
   Index2Node = (Node *) malloc(sizeof(Node)*Nnodes);
   Index2Edge = (Edge *) malloc(sizeof(Edge)*Nedges);
 
-  if ((AdjMatrix==NULL)||(Index2Node==NULL)||(Index2Edge==NULL)) { 
+  if (((AdjMatrix==NULL)&&(AdjMatrixF==NULL))||(Index2Node==NULL)||(Index2Edge==NULL)) { 
     cout << "Out of memory in constructor of AdjacencyMatrix\n"; 
-    ADJMAT_FreeNotNull(AdjMatrix); ADJMAT_FreeNotNull(Index2Node); ADJMAT_FreeNotNull(Index2Edge);
+    ADJMAT_FreeNotNull(AdjMatrix); ADJMAT_FreeNotNull(AdjMatrixF);
+    ADJMAT_FreeNotNull(Index2Node); ADJMAT_FreeNotNull(Index2Edge);
     exit(0);}
 
   i = 0;
@@ -1068,55 +1530,393 @@ AdjacencyMatrix::AdjacencyMatrix(ListGraph &graph,EdgeValueMap &graphweight,doub
   }
 
   // Initially all edges have infinity weight
-  for (int i=0;i<Nmatrix;i++) AdjMatrix[i] = NonEdgeValue;
+  if (AdjMatrix) for (size_t k=0;k<Nmatrix;k++) AdjMatrix[k] = NonEdgeValue;
+  else for (size_t k=0;k<Nmatrix;k++) AdjMatrixF[k] = (float) NonEdgeValue;
   // Then, update the existing edges with the correct weight
+  i = 0;
   for (EdgeIt e(graph); e != INVALID; ++e) {
     Node u,v;    int i_u,i_v;
+    Index2Edge[i] = e;  Edge2Index[e] = i;  i++;
     u = graph.u(e);  v = graph.v(e);  // obtain the extremities of e
     i_u = Node2Index[u];
     i_v = Node2Index[v];
-    if (i_u > i_v) AdjMatrix[i_u*(i_u-1)/2+i_v] = graphweight[e];
-    else if (i_u < i_v) AdjMatrix[i_v*(i_v-1)/2+i_u] = graphweight[e];
-    else {
-      cout << "Out of memory in constructor of AdjacencyMatrix\n"; 
+    if (i_u == i_v) {
+      cout << "Loop edges are not allowed in AdjacencyMatrix\n"; 
       exit(0);}
+    if (AdjMatrix) {
+      AdjMatrix[(size_t) i_u*Nnodes+i_v] = graphweight[e];
+      AdjMatrix[(size_t) i_v*Nnodes+i_u] = graphweight[e];
+    } else {
+      AdjMatrixF[(size_t) i_u*Nnodes+i_v] = (float) graphweight[e];
+      AdjMatrixF[(size_t) i_v*Nnodes+i_u] = (float) graphweight[e];
+    }
   }
+  // the diagonal keeps NonEdgeValue
 }
 
 double AdjacencyMatrix::Cost(Node u,Node v)
 {
-  int i_u,i_v;
-  i_u = Node2Index[u];
-  i_v = Node2Index[v];
-  globalcounter++;
-  //cout << "globalcounter1 = " << globalcounter << endl;
-  try{
-    if (i_u > i_v) return(AdjMatrix[i_u*(i_u-1)/2+i_v]);
-    else if (i_u < i_v) return(AdjMatrix[i_v*(i_v-1)/2+i_u]);
-    else return(NonEdgeValue);
-  }catch (...) {
-    cout << "Exception: " << globalcounter << endl;
-    exit(1);
-  }
+  return(Cost(Node2Index[u],Node2Index[v]));
 }
 
 double AdjacencyMatrix::Cost(Edge e)
 {
-  int i_u,i_v;
-  Node u,v;
-  globalcounter++;
-  //cout << "globalcounter2 = " << globalcounter << endl;
-  u = (*g).u(e);  v = (*g).v(e);
-  i_u = Node2Index[u];
-  i_v = Node2Index[v];
-  if (i_u > i_v) return(AdjMatrix[i_u*(i_u-1)/2+i_v]);
-  else return(AdjMatrix[i_v*(i_v-1)/2+i_u]);
+  return(Cost(Node2Index[(*g).u(e)],Node2Index[(*g).v(e)]));
 }
 
 
 AdjacencyMatrix::~AdjacencyMatrix()
 {
-  ADJMAT_FreeNotNull(AdjMatrix); ADJMAT_FreeNotNull(Index2Node); ADJMAT_FreeNotNull(Index2Edge);
+  ADJMAT_FreeNotNull(AdjMatrix); ADJMAT_FreeNotNull(AdjMatrixF);
+  ADJMAT_FreeNotNull(Index2Node); ADJMAT_FreeNotNull(Index2Edge);
+}
+
+
+// Complete euclidean graph given by its points (see mygraphlib.h).
+void EuclideanGraph::Reserve(int n)
+{
+  vname.reserve(n);  posx.reserve(n);  posy.reserve(n);
+}
+
+int EuclideanGraph::AddNode(string name,double x,double y)
+{
+  vname.push_back(name);  posx.push_back(x);  posy.push_back(y);
+  Ncandidates = 0;  candidates.clear(); // the lists are not valid anymore
+  return(Nnodes++);
+}
+
+// The costs are computed two (SSE2) or four (AVX) at a time. The sqrt of
+// these instructions is correctly rounded, so the values are the same
+// given by Cost.
+void EuclideanGraph::Costs(int u,const int *v,int m,double *d) const
+{
+  int i=0;
+#if defined(__SSE2__)
+  __m128d ux=_mm_set1_pd(posx[u]),uy=_mm_set1_pd(posy[u]);
+  for (;i+2<=m;i+=2) {
+    __m128d dx=_mm_sub_pd(_mm_set_pd(posx[v[i+1]],posx[v[i]]),ux);
+    __m128d dy=_mm_sub_pd(_mm_set_pd(posy[v[i+1]],posy[v[i]]),uy);
+    _mm_storeu_pd(d+i,_mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx,dx),_mm_mul_pd(dy,dy))));
+  }
+#endif
+  for (;i<m;i++) d[i] = Cost(u,v[i]);
+}
+
+void EuclideanGraph::Costs(int u,double *d) const
+{
+  int v=0;
+  const double *x=posx.data(),*y=posy.data();
+#if defined(__AVX__)
+  __m256d ux=_mm256_set1_pd(posx[u]),uy=_mm256_set1_pd(posy[u]);
+  for (;v+4<=Nnodes;v+=4) {
+    __m256d dx=_mm256_sub_pd(_mm256_loadu_pd(x+v),ux);
+    __m256d dy=_mm256_sub_pd(_mm256_loadu_pd(y+v),uy);
+    _mm256_storeu_pd(d+v,_mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx,dx),_mm256_mul_pd(dy,dy))));
+  }
+#elif defined(__SSE2__)
+  __m128d ux=_mm_set1_pd(posx[u]),uy=_mm_set1_pd(posy[u]);
+  for (;v+2<=Nnodes;v+=2) {
+    __m128d dx=_mm_sub_pd(_mm_loadu_pd(x+v),ux);
+    __m128d dy=_mm_sub_pd(_mm_loadu_pd(y+v),uy);
+    _mm_storeu_pd(d+v,_mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx,dx),_mm_mul_pd(dy,dy))));
+  }
+#endif
+  for (;v<Nnodes;v++) d[v] = Cost(u,v);
+}
+
+// The points are distributed in a grid with about two points per cell. The
+// neighbours of u are searched in rings of cells around the cell of u,
+// until the k-th nearest neighbour found is closer than any point outside
+// the rings. Ties are broken by the node index.
+void EuclideanGraph::BuildCandidates(int k)
+{
+  int n=Nnodes,ncells,cx,cy,r,i,c;
+  double minx,maxx,miny,maxy,cw,ch;
+  if (k>n-1) k=n-1;
+  if (k<0) k=0;
+  Ncandidates = k;
+  candidates.assign((size_t) n*k,-1);
+  if (k==0) return;
+
+  minx=maxx=posx[0];  miny=maxy=posy[0];
+  for (i=1;i<n;i++) {
+    minx=min(minx,posx[i]);  maxx=max(maxx,posx[i]);
+    miny=min(miny,posy[i]);  maxy=max(maxy,posy[i]);
+  }
+  ncells = max(1,(int) sqrt(n/2.0));
+  cw = (maxx-minx)/ncells;  if (cw<=0) cw=1.0;
+  ch = (maxy-miny)/ncells;  if (ch<=0) ch=1.0;
+  // counting sort of the points by cell
+  vector<int> cellx(n),celly(n),cellstart(ncells*ncells+1,0),cellnodes(n);
+  for (i=0;i<n;i++) {
+    cellx[i] = min(ncells-1,(int) ((posx[i]-minx)/cw));
+    celly[i] = min(ncells-1,(int) ((posy[i]-miny)/ch));
+    cellstart[celly[i]*ncells+cellx[i]+1]++;
+  }
+  for (c=0;c<ncells*ncells;c++) cellstart[c+1] += cellstart[c];
+  vector<int> next(cellstart.begin(),cellstart.end()-1);
+  for (i=0;i<n;i++) cellnodes[next[celly[i]*ncells+cellx[i]]++] = i;
+
+  vector<pair<double,int> > heap; // max-heap with the k nearest found
+  heap.reserve(k+1);
+  for (int u=0;u<n;u++) {
+    heap.clear();
+    cx = cellx[u];  cy = celly[u];
+    for (r=0;;r++) {
+      int x0=cx-r,x1=cx+r,y0=cy-r,y1=cy+r;
+      for (int y=max(0,y0);y<=min(ncells-1,y1);y++)
+	for (int x=max(0,x0);x<=min(ncells-1,x1);x++) {
+	  if ((y!=y0)&&(y!=y1)&&(x!=x0)&&(x!=x1)) continue; // not in the ring
+	  c = y*ncells+x;
+	  for (i=cellstart[c];i<cellstart[c+1];i++) {
+	    int v=cellnodes[i];
+	    if (v==u) continue;
+	    pair<double,int> p(Cost(u,v),v);
+	    if ((int) heap.size()<k) {heap.push_back(p); push_heap(heap.begin(),heap.end());}
+	    else if (p<heap.front()) {
+	      pop_heap(heap.begin(),heap.end());  heap.back()=p;
+	      push_heap(heap.begin(),heap.end());}
+	  }
+	}
+      if ((x0<=0)&&(y0<=0)&&(x1>=ncells-1)&&(y1>=ncells-1)) break; // all cells visited
+      if ((int) heap.size()<k) continue;
+      // distance from u to the nearest cell outside the rings
+      double gap=DBL_MAX;
+      if (x0>0) gap=min(gap,posx[u]-(minx+x0*cw));
+      if (x1<ncells-1) gap=min(gap,(minx+(x1+1)*cw)-posx[u]);
+      if (y0>0) gap=min(gap,posy[u]-(miny+y0*ch));
+      if (y1<ncells-1) gap=min(gap,(miny+(y1+1)*ch)-posy[u]);
+      if (gap>heap.front().first) break;
+    }
+    sort_heap(heap.begin(),heap.end());
+    for (i=0;i<k;i++) candidates[(size_t) u*k+i] = heap[i].second;
+  }
+}
+
+bool EuclideanGraph::DelaunayEdges(vector<pair<int,int> > &edges) const
+{
+  int n=Nnodes,ntri,i,j;
+  edges.clear();
+  if (n<3) {
+    if (n==2) edges.push_back(make_pair(0,1));
+    return(true);
+  }
+  vector<double> p(2*n);
+  vector<int> tri(6*n),tri_nabe(6*n);
+  for (i=0;i<n;i++) {p[2*i]=posx[i];  p[2*i+1]=posy[i];}
+  if (r8tris2(n,&p[0],&ntri,&tri[0],&tri_nabe[0])) return(false);
+  edges.reserve(3*ntri);
+  for (i=0;i<ntri;i++)
+    for (j=0;j<3;j++) { // each edge of a triangle, the indices of geompack start at 1
+      int a=tri[3*i+j]-1,b=tri[3*i+(j+1)%3]-1;
+      edges.push_back(make_pair(min(a,b),max(a,b)));
+    }
+  sort(edges.begin(),edges.end()); // the inner edges are in two triangles
+  edges.erase(unique(edges.begin(),edges.end()),edges.end());
+  return(true);
+}
+
+void EuclideanGraph::BuildListGraph(ListGraph &g,
+				    NodeStringMap &nodename,
+				    EdgeValueMap &weight,
+				    NodePosMap &px,
+				    NodePosMap &py,
+				    vector<Node> &Index2Node,
+				    bool candidatesonly) const
+{
+  int u,v,i,j;
+  Index2Node.resize(Nnodes);
+  g.reserveNode(Nnodes);
+  for (u=0;u<Nnodes;u++) {
+    Node a = g.addNode();
+    Index2Node[u] = a;  nodename[a] = vname[u];  px[a] = posx[u];  py[a] = posy[u];
+  }
+  if (!candidatesonly) {
+    // same order of the edges given by the previous ReadEuclideanListGraph
+    size_t m=(size_t) Nnodes*(Nnodes-1)/2;
+    if (m > (size_t) INT_MAX) {
+      cout << "Too many edges (" << m << ") for a complete ListGraph with "
+	   << Nnodes << " nodes.\n";
+      exit(0);}
+    g.reserveEdge((int) m);
+    for (v=Nnodes-1;v>=0;v--)
+      for (u=v-1;u>=0;u--) {
+	Edge e = g.addEdge(Index2Node[u],Index2Node[v]);
+	weight[e] = Cost(u,v);
+      }
+    return;
+  }
+  g.reserveEdge(Nnodes*Ncandidates);
+  for (u=0;u<Nnodes;u++)
+    for (i=0;i<Ncandidates;i++) {
+      v = Candidates(u)[i];
+      if (v<u) { // edge {u,v} was already inserted if u is a candidate of v
+	for (j=0;j<Ncandidates && Candidates(v)[j]!=u;j++);
+	if (j<Ncandidates) continue;
+      }
+      Edge e = g.addEdge(Index2Node[u],Index2Node[v]);
+      weight[e] = Cost(u,v);
+    }
+}
+
+bool GenerateRandomEuclideanGraph(EuclideanGraph &eg,
+				  int n, // number of nodes
+				  double SizeX, // coordinate x is a random number in [0,SizeX)
+				  double SizeY) // coordinate y is a random number in [0,SizeY)
+{
+  eg.Reserve(n);
+  for (int i=0;i<n;i++) {  // same sequence of GenerateRandomEuclideanListGraph
+    double x = SizeX*drand48();
+    double y = SizeY*drand48();
+    eg.AddNode(IntToString(i+1),x,y);
+  }
+  return(true);
+}
+
+
+// Two-level doubly-linked list tour (see mygraphlib.h). Inside a segment
+// the nodes are linked by nnext/nprev (-1 at the ends) and have increasing
+// seq numbers from first to last. The segments are linked in a ring, in the
+// order of the tour, with ranks 0..nsegments-1. Splits create new segments,
+// and the list is rebuilt when there are too many of them.
+void TSPTour::Set(const vector<int> &order)
+{
+  int s,i,m;
+  n = order.size();
+  groupsize = max(1,(int) sqrt((double) n));
+  m = (n+groupsize-1)/groupsize;
+  nnext.assign(n,-1);  nprev.assign(n,-1);  parent.assign(n,0);  seq.assign(n,0);
+  seg.resize(m);  seg.reserve(3*m+4);
+  nsegments = m;
+  for (s=0;s<m;s++) {
+    int b=s*groupsize,e=min(n,b+groupsize);
+    Segment &S=seg[s];
+    S.first=order[b];  S.last=order[e-1];  S.size=e-b;  S.reversed=false;
+    S.next=(s+1)%m;  S.prev=(s-1+m)%m;  S.rank=s;
+    for (i=b;i<e;i++) {
+      int v=order[i];
+      parent[v]=s;  seq[v]=i-b;
+      nprev[v] = (i>b) ? order[i-1] : -1;
+      nnext[v] = (i<e-1) ? order[i+1] : -1;
+    }
+  }
+}
+
+bool TSPTour::Between(int a,int b,int c) const
+{
+  long long ka=Key(a),kb=Key(b),kc=Key(c);
+  if (ka<=kc) return((ka<=kb)&&(kb<=kc));
+  return((kb>=ka)||(kb<=kc));
+}
+
+void TSPTour::Sequence(vector<int> &order,int start) const
+{
+  order.resize(n);
+  for (int i=0,v=start;i<n;i++,v=Next(v)) order[i]=v;
+}
+
+void TSPTour::Renumber()
+{
+  for (int i=0,s=0;i<nsegments;i++,s=seg[s].next) seg[s].rank=i;
+}
+
+// Make v the first node (in the tour order) of a segment. The smaller part
+// of its segment goes to a new segment.
+void TSPTour::SplitBefore(int v)
+{
+  int s=parent[v],t,x,left,right;
+  if (v==Head(s)) return;
+  // internal orientation: [first..left] and [right..last]
+  if (!seg[s].reversed) {left=nprev[v]; right=v;}
+  else {left=v; right=nnext[v];}
+  int sizeleft=seq[left]-seq[seg[s].first]+1;
+  bool moveleft;
+  t = nsegments++;
+  if ((int) seg.size()<nsegments) seg.resize(nsegments);
+  Segment &S=seg[s],&T=seg[t];
+  T.reversed = S.reversed;
+  moveleft = (2*sizeleft<=S.size);
+  if (moveleft) { // the left part goes to t
+    T.first=S.first;  T.last=left;  T.size=sizeleft;
+    S.first=right;  S.size-=sizeleft;
+  } else {
+    T.first=right;  T.last=S.last;  T.size=S.size-sizeleft;
+    S.last=left;  S.size=sizeleft;
+  }
+  nnext[left]=-1;  nprev[right]=-1;
+  for (x=T.first;x!=-1;x=nnext[x]) parent[x]=t;
+  // the left part comes before the right part in the tour if not reversed
+  if (moveleft != S.reversed) {
+    T.prev=S.prev;  T.next=s;  seg[S.prev].next=t;  S.prev=t;
+  } else {
+    T.next=S.next;  T.prev=s;  seg[S.next].prev=t;  S.next=t;
+  }
+  Renumber();
+}
+
+// Reverse the nodes x..y (internal orientation) of segment s
+void TSPTour::ReverseInside(int s,int x,int y)
+{
+  int px=nprev[x],ny=nnext[y],k,len,base=seq[x];
+  aux.clear();
+  for (k=x;;k=nnext[k]) {aux.push_back(k); if (k==y) break;}
+  len=aux.size();
+  for (k=0;k<len;k++) {
+    int v=aux[len-1-k];
+    seq[v]=base+k;
+    nprev[v] = (k>0) ? aux[len-k] : px;
+    nnext[v] = (k<len-1) ? aux[len-2-k] : ny;
+  }
+  if (px!=-1) nnext[px]=y; else seg[s].first=y;
+  if (ny!=-1) nprev[ny]=x; else seg[s].last=x;
+}
+
+// Reverse the segments from s1 to sk (in the order of the tour)
+void TSPTour::ReverseSegments(int s1,int sk)
+{
+  int L=seg[s1].prev,R=seg[sk].next,s=s1;
+  while (true) {
+    int nxt=seg[s].next;
+    swap(seg[s].next,seg[s].prev);
+    seg[s].reversed = !seg[s].reversed;
+    if (s==sk) break;
+    s=nxt;
+  }
+  seg[L].next=sk;  seg[sk].prev=L;
+  seg[s1].next=R;  seg[R].prev=s1;
+  Renumber();
+}
+
+void TSPTour::Reverse(int a,int b)
+{
+  int s,sa,sb,k;
+  if (a==b) return;
+  s=parent[a];
+  if (s==parent[b]) { // path inside a segment
+    bool rev=seg[s].reversed;
+    if ((!rev && seq[a]<=seq[b]) || (rev && seq[a]>=seq[b])) {
+      if (abs(seq[a]-seq[b])<groupsize) {
+	if (!rev) ReverseInside(s,a,b); else ReverseInside(s,b,a);
+	return;
+      }
+    }
+  }
+  if (Next(b)==a) return; // the whole tour
+  if (nsegments+2>3*((n+groupsize-1)/groupsize)+2) {Sequence(aux,a); vector<int> order(aux); Set(order);}
+  SplitBefore(a);
+  SplitBefore(Next(b));
+  sa=parent[a];  sb=parent[b];
+  k=(seg[sb].rank-seg[sa].rank+nsegments)%nsegments+1;
+  // the complementary path gives the same tour, so the shorter is reversed
+  if (2*k>nsegments) ReverseSegments(seg[sb].next,seg[sa].prev);
+  else ReverseSegments(sa,sb);
+}
+
+void TSPTour::Make2OptMove(int a,int b,int c,int d)
+{
+  if (Next(a)==b) Reverse(b,c); // a b ... c d
+  else Reverse(c,b);            // d c ... b a
+  (void) d;
 }
 
 
@@ -1289,3 +2089,115 @@ int ViewGomoryHuTree(ListGraph &g,
   return(ViewListGraph(g,tvname,tename,tvcolor,tecolor,text));
 }
 
+
+//----------------------------------------------------------------------
+// CutPool
+
+CutPool::CutPool(const ListGraph &g)
+{
+  directed = false;
+  Tail.assign(g.maxEdgeId()+1,-1);  Head.assign(g.maxEdgeId()+1,-1);
+  for (EdgeIt e(g); e!=INVALID; ++e) {
+    Tail[g.id(e)] = g.id(g.u(e));  Head[g.id(e)] = g.id(g.v(e));
+  }
+  for (NodeIt v(g); v!=INVALID; ++v) NodeIds.push_back(g.id(v));
+  NodeRef = NodeIds.empty() ? -1 : NodeIds[0];
+  InS.assign(g.maxNodeId()+1,0);
+  NodeStart.push_back(0);  EdgeStart.push_back(0);
+  Last.Callbacks=Last.Generated=Last.Duplicates=Last.FromPool=0;  Last.Time=0.0;
+  Total = Last;  StartTime = 0.0;
+}
+
+CutPool::CutPool(const ListDigraph &g)
+{
+  directed = true;
+  Tail.assign(g.maxArcId()+1,-1);  Head.assign(g.maxArcId()+1,-1);
+  for (ListDigraph::ArcIt a(g); a!=INVALID; ++a) {
+    Tail[g.id(a)] = g.id(g.source(a));  Head[g.id(a)] = g.id(g.target(a));
+  }
+  for (ListDigraph::NodeIt v(g); v!=INVALID; ++v) NodeIds.push_back(g.id(v));
+  NodeRef = -1;
+  InS.assign(g.maxNodeId()+1,0);
+  NodeStart.push_back(0);  EdgeStart.push_back(0);
+  Last.Callbacks=Last.Generated=Last.Duplicates=Last.FromPool=0;  Last.Time=0.0;
+  Total = Last;  StartTime = 0.0;
+}
+
+int CutPool::Add(const vector<int> &S,double rhs)
+{
+  unsigned long long h=14695981039346656037ULL; // FNV-1a hash of the sorted node set
+  int i;
+  for (i=0;i<(int) S.size();i++) InS[S[i]]=1;
+  Set.clear();
+  if (!directed && InS[NodeRef]) { // store the side without NodeRef
+    for (i=0;i<(int) NodeIds.size();i++) if (!InS[NodeIds[i]]) Set.push_back(NodeIds[i]);
+  } else Set = S;
+  for (i=0;i<(int) S.size();i++) InS[S[i]]=0;
+  sort(Set.begin(),Set.end());
+  for (i=0;i<(int) Set.size();i++) {h ^= (unsigned) Set[i];  h *= 1099511628211ULL;}
+
+  pair<unordered_multimap<unsigned long long,int>::iterator,
+       unordered_multimap<unsigned long long,int>::iterator> r=Hash2Cut.equal_range(h);
+  for (unordered_multimap<unsigned long long,int>::iterator it=r.first;it!=r.second;++it) {
+    int c=it->second;
+    if ((NodeStart[c+1]-NodeStart[c]==(int) Set.size()) &&
+	equal(Set.begin(),Set.end(),CutNodes.begin()+NodeStart[c]))
+      {Last.Duplicates++;  Total.Duplicates++;  return(-1);}
+  }
+  int c=NCuts();
+  Hash2Cut.insert(make_pair(h,c));
+  CutNodes.insert(CutNodes.end(),Set.begin(),Set.end());
+  NodeStart.push_back((int) CutNodes.size());
+  for (i=0;i<(int) Set.size();i++) InS[Set[i]]=1;
+  for (int e=0;e<(int) Tail.size();e++) {
+    if (Tail[e]<0) continue;
+    if (directed ? (InS[Tail[e]] && !InS[Head[e]]) : (InS[Tail[e]]!=InS[Head[e]]))
+      CutEdges.push_back(e);
+  }
+  for (i=0;i<(int) Set.size();i++) InS[Set[i]]=0;
+  EdgeStart.push_back((int) CutEdges.size());
+  RhsValue.push_back(rhs);
+  Last.Generated++;  Total.Generated++;
+  return(c);
+}
+
+double CutPool::Value(int i,const double *x) const
+{
+  double v=0.0;
+  for (int k=EdgeStart[i];k<EdgeStart[i+1];k++) v += x[CutEdges[k]];
+  return(v);
+}
+
+int CutPool::FindViolated(const double *x,vector<int> &Violated,double eps)
+{
+  int nv=0;
+  for (int i=0;i<NCuts();i++)
+    if (Value(i,x) < RhsValue[i]-eps) {Violated.push_back(i);  nv++;}
+  Last.FromPool += nv;  Total.FromPool += nv;
+  return(nv);
+}
+
+static double CutPoolClock()
+{
+  return(chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void CutPool::StartCallback()
+{
+  Last.Callbacks=1;  Last.Generated=Last.Duplicates=Last.FromPool=0;  Last.Time=0.0;
+  Total.Callbacks++;
+  StartTime = CutPoolClock();
+}
+
+void CutPool::EndCallback()
+{
+  Last.Time = CutPoolClock()-StartTime;
+  Total.Time += Last.Time;
+}
+
+void CutPool::PrintStatistics(string name) const
+{
+  cout << "[" << name << "] " << Total.Callbacks << " callbacks, "
+       << Total.Generated << " cuts generated, " << Total.Duplicates << " duplicates, "
+       << Total.FromPool << " cuts from the pool, " << Total.Time << " seconds\n";
+}
@@ -13,7 +13,10 @@
 #include<lemon/gomory_hu.h>
 #include<lemon/math.h>
 #include<lemon/preflow.h>
+#include<stdint.h>
 #include<string>
+#include<unordered_map>
+#include<vector>
 #include "myutils.h"
 #include "geompack.hpp"
 
@@ -84,6 +87,47 @@ typedef Digraph::NodeMap<Arc> DNodeArcMap;
 
 
 
+// Tokenizer used by the graph readers. The whole file is read with a single
+// call and the tokens (separated by blanks) are given as [begin,end) pointers
+// into the buffer, numbers are parsed in place and node names are interned
+// in a hash table over the buffer, so no memory is allocated per token.
+class GraphFileTokenizer {
+public:
+  GraphFileTokenizer() : pos(0), nnames(0) {}
+  // Read the file. Return false if it cannot be read.
+  bool Open(string filename);
+  // Skip the lines starting with '#', as PulaBrancoComentario.
+  void SkipComments();
+  // Next token of the file. Return false at the end of the file.
+  bool NextToken(const char *&begin,const char *&end);
+  // Next token of the current line. Return false at the end of the line.
+  bool NextTokenInLine(const char *&begin,const char *&end);
+  // Move to the beginning of the next line that is not blank.
+  // Return false at the end of the file.
+  bool NextLine();
+  // Read the next token as a number. Return false if there is none or it is
+  // not a number.
+  bool ReadInt(int &x);
+  bool ReadDouble(double &x);
+  // Parse [begin,end) as a number, with x=0 if it is not a number (as atoi/atof).
+  static bool ParseInt(const char *begin,const char *end,int &x);
+  static bool ParseDouble(const char *begin,const char *end,double &x);
+  // Node names, each one with an index given when it is added. AddName
+  // returns false if the name was already added, FindName returns -1 if
+  // the name was not added.
+  void ReserveNames(int n);
+  bool AddName(const char *begin,const char *end,int index);
+  int FindName(const char *begin,const char *end) const;
+private:
+  struct NameEntry { const char *name; uint32_t length; uint32_t hash; int index; };
+  vector<char> buffer;
+  size_t pos;
+  vector<NameEntry> names;
+  size_t nnames;
+  static uint32_t Hash(const char *begin,const char *end);
+  void RehashNames(size_t capacity);
+};
+
 // read a list digraph. If go_and_back is true, for a line [u,v,cost] the 
 // routine insert the arc (u,v) and (v,u), both with cost custo. Otherwise,
 // it insert only the arc (u,v).
@@ -111,6 +155,82 @@ bool ReadListGraph(string filename,
 		   NodePosMap   & posx,
 		   NodePosMap   & posy);
 
+// Read a graph with weights and values in the nodes, and a capacity, in the format:
+// <number_of_nodes> <number_of_edges> <capacity>, a line <node_name> <weight> <value>
+// for each node and a line <node_u> <node_v> for each edge.
+bool ReadListGraph3(string filename,
+		    ListGraph &g,
+		    NodeStringMap &vname,
+		    NodeIntMap &weight,
+		    NodeIntMap &value,
+		    NodePosMap &posx,
+		    NodePosMap &posy,
+		    int &C);
+
+// Binary graph files, a compact form of the files above that is loaded
+// with a single mmap and no parsing. They hold node names, positions, the
+// edges in CSR form with their weights and, optionally, the node weights,
+// values and capacity of ReadListGraph3. ReadListGraph and ReadListGraph3
+// recognize binary files and read them with ReadListGraphBinary.
+bool IsBinaryGraphFile(string filename);
+
+bool WriteListGraphBinary(string filename,
+			  ListGraph &g,
+			  NodeStringMap &vname,
+			  EdgeValueMap &weight,
+			  NodePosMap &posx,
+			  NodePosMap &posy);
+
+bool WriteListGraphBinary(string filename,
+			  ListGraph &g,
+			  NodeStringMap &vname,
+			  EdgeValueMap &weight,
+			  NodePosMap &posx,
+			  NodePosMap &posy,
+			  NodeIntMap &nodeweight,
+			  NodeIntMap &nodevalue,
+			  int capacity);
+
+bool ReadListGraphBinary(string filename,
+			 ListGraph &g,
+			 NodeStringMap &vname,
+			 EdgeValueMap &weight,
+			 NodePosMap &posx,
+			 NodePosMap &posy);
+
+// Return false if the file has no node weights and values.
+bool ReadListGraphBinary(string filename,
+			 ListGraph &g,
+			 NodeStringMap &vname,
+			 EdgeValueMap &weight,
+			 NodePosMap &posx,
+			 NodePosMap &posy,
+			 NodeIntMap &nodeweight,
+			 NodeIntMap &nodevalue,
+			 int &capacity);
+
+// Binary CFLP instances, written as a stream by generate_cflp_instance and
+// read by ex_cflp. The header is followed by one record for each client, one
+// for each facility and one for each arc (client -> facility, given by the
+// node indices). Names are implicit: the client i is "c<i+1>" and the
+// facility j is "f<j+1>".
+#define CFLP_BINARY_MAGIC "MYCFLPB1"
+typedef struct {
+  char magic[8];
+  uint32_t nclients, nfacilities;
+  uint64_t narcs;
+} CFLPBinaryHeader;
+
+typedef struct {
+  double x, y, weight;  // weight and capacity are 0 for clients
+  int64_t capacity;
+} CFLPBinaryNode;
+
+typedef struct {
+  uint32_t client, facility;
+  double weight;
+} CFLPBinaryArc;
+
 
 // ==============================================================
 
@@ -194,23 +314,191 @@ bool GenerateTriangulatedListGraph(ListGraph &g, // return with generated graph
 
 
 
+// Compile with -DADJMAT_COUNTCOSTS to count the calls of AdjacencyMatrix::Cost
+// in globalcounter.
+#ifdef ADJMAT_COUNTCOSTS
+extern long long globalcounter;
+#define ADJMAT_COUNTCOST() (globalcounter++)
+#else
+#define ADJMAT_COUNTCOST()
+#endif
+
+// Adjacency matrix of a graph, stored as a full square row-major matrix
+// indexed by node indices (0..Nnodes-1), so the row of a node is contiguous.
+// Hot loops should translate nodes to indices once (Node2Index/Index2Node)
+// and use Cost(int,int). With singleprecision the matrix is stored in
+// floats, using half of the memory (a graph with 20000 nodes uses 1.6GB).
 class AdjacencyMatrix {
 public:
-  AdjacencyMatrix(ListGraph &graph,EdgeValueMap &graphweight,double NonEdgeValue);
+  AdjacencyMatrix(ListGraph &graph,EdgeValueMap &graphweight,double NonEdgeValue,
+		  bool singleprecision=false);
   ~AdjacencyMatrix();
-  double *AdjMatrix;
+  double *AdjMatrix;   // matrix in double precision (NULL with singleprecision)
+  float *AdjMatrixF;   // matrix in single precision (NULL otherwise)
   ListGraph *g;
   EdgeValueMap *weight;
-  int Nnodes,Nedges,Nmatrix;
+  int Nnodes,Nedges;
+  size_t Nmatrix;
   double NonEdgeValue;
   Node *Index2Node;
   Edge *Index2Edge;
+  inline double Cost(int i,int j) const {
+    ADJMAT_COUNTCOST();
+    size_t k = (size_t) i*Nnodes+j;
+    return(AdjMatrix ? AdjMatrix[k] : (double) AdjMatrixF[k]);
+  }
   double Cost(Node,Node);
   double Cost(Edge);
   NodeIndexMap Node2Index;
   EdgeIndexMap Edge2Index;
 };
 
+// Complete euclidean graph given only by its points. The nodes are the
+// indices 0..Nnodes-1 and the cost of an edge is computed when asked, so
+// a graph with n points uses O(n) memory, instead of the n(n-1)/2 edges of
+// a complete ListGraph. Candidate lists (the k nearest neighbours of each
+// node) can be built for heuristics that look only at short edges.
+class EuclideanGraph {
+public:
+  EuclideanGraph() : Nnodes(0), Ncandidates(0) {}
+  int Nnodes;
+  vector<string> vname;
+  vector<double> posx,posy;
+  void Reserve(int n);
+  int AddNode(string name,double x,double y);
+  inline double Cost(int u,int v) const
+  { double dx=posx[u]-posx[v],dy=posy[u]-posy[v]; return(sqrt(dx*dx+dy*dy)); }
+  // d[i] = Cost(u,v[i]), for i=0..m-1
+  void Costs(int u,const int *v,int m,double *d) const;
+  // d[v] = Cost(u,v), for all nodes v
+  void Costs(int u,double *d) const;
+  // Candidate lists, with the k nearest neighbours of each node in
+  // nondecreasing order of cost. Built with a grid over the points.
+  void BuildCandidates(int k);
+  int Ncandidates;
+  inline const int *Candidates(int u) const { return(&candidates[(size_t) u*Ncandidates]); }
+  // Edges (u,v), u<v, of the Delaunay triangulation of the points (at most
+  // 3n edges), computed by geompack. Return false if the triangulation
+  // fails (e.g., repeated or collinear points).
+  bool DelaunayEdges(vector<pair<int,int> > &edges) const;
+  // Copy the graph to a ListGraph, with all edges or only the edges given
+  // by the candidate lists. The node of index i is Index2Node[i].
+  void BuildListGraph(ListGraph &g,
+		      NodeStringMap &nodename,
+		      EdgeValueMap &weight,
+		      NodePosMap &px,
+		      NodePosMap &py,
+		      vector<Node> &Index2Node,
+		      bool candidatesonly) const;
+private:
+  vector<int> candidates;
+};
+
+// Tour (hamiltonian circuit) over the nodes 0..n-1, stored in a two-level
+// doubly-linked list: the tour is split in about sqrt(n) segments, each one
+// with a reversed bit, so Next/Prev/Between take O(1) and reversing a path
+// takes O(sqrt(n)) instead of O(n) of an array.
+class TSPTour {
+public:
+  TSPTour() : n(0), groupsize(1), nsegments(0) {}
+  // order[i] is the i-th node of the tour
+  void Set(const vector<int> &order);
+  int Nnodes() const { return(n); }
+  // Successor and predecessor of v. Next(v,1) is the predecessor of v.
+  inline int Next(int v) const {
+    const Segment &S=seg[parent[v]];
+    if (v==(S.reversed ? S.first : S.last)) return(Head(S.next));
+    return(S.reversed ? nprev[v] : nnext[v]);
+  }
+  inline int Prev(int v) const {
+    const Segment &S=seg[parent[v]];
+    if (v==(S.reversed ? S.last : S.first)) return(Tail(S.prev));
+    return(S.reversed ? nnext[v] : nprev[v]);
+  }
+  inline int Next(int v,int dir) const { return(dir==0 ? Next(v) : Prev(v)); }
+  // Return true if b is in the path from a to c (following Next)
+  bool Between(int a,int b,int c) const;
+  // The nodes in the order of the tour, starting at node start
+  void Sequence(vector<int> &order,int start=0) const;
+  // Reverse the path from a to b (following Next)
+  void Reverse(int a,int b);
+  // 2OPT move that removes the edges (a,b) and (c,d) and inserts (a,c) and
+  // (b,d). The nodes b and d must be both successors or both predecessors
+  // of a and c.
+  void Make2OptMove(int a,int b,int c,int d);
+private:
+  // first and last are the ends of the segment in its own orientation, which
+  // is the orientation of the tour if the segment is not reversed.
+  struct Segment { int first,last,next,prev,rank,size; bool reversed; };
+  int n,groupsize,nsegments;
+  vector<int> nnext,nprev,parent,seq;
+  vector<Segment> seg;
+  vector<int> aux;
+  inline int Head(int s) const { return(seg[s].reversed ? seg[s].last : seg[s].first); }
+  inline int Tail(int s) const { return(seg[s].reversed ? seg[s].first : seg[s].last); }
+  inline long long Key(int v) const {
+    const Segment &S=seg[parent[v]];
+    return((long long) S.rank*(2*n+1)+(S.reversed ? n-seq[v] : seq[v]));
+  }
+  void SplitBefore(int v);
+  void ReverseInside(int s,int x,int y);
+  void ReverseSegments(int s1,int sk);
+  void Renumber();
+};
+
+// Pool of the cuts x(delta(S)) >= rhs (ListGraph) or x(delta^+(S)) >= rhs
+// (ListDigraph) added by a separation callback. The cuts are hashed by
+// their node sets S (given by node ids), so a cut found again is rejected,
+// and the pool can be scanned for violated cuts before running any
+// max-flow. The values x are indexed by edge (arc) ids. The graph must not
+// change after the pool is built. For a ListGraph, S and V-S are the same cut.
+class CutPool {
+public:
+  CutPool(const ListGraph &g);
+  CutPool(const ListDigraph &g);
+  // Add the cut of node set S. Return the index of the cut, or -1 if
+  // it is already in the pool.
+  int Add(const vector<int> &S,double rhs);
+  int NCuts() const { return((int) RhsValue.size()); }
+  double Rhs(int i) const { return(RhsValue[i]); }
+  // ids of the edges (arcs) of cut i
+  const int *Edges(int i) const { return(&CutEdges[0]+EdgeStart[i]); }
+  int NEdges(int i) const { return(EdgeStart[i+1]-EdgeStart[i]); }
+  double Value(int i,const double *x) const;
+  // Append to Violated the cuts with value less than their rhs-eps.
+  // Return the number of cuts appended.
+  int FindViolated(const double *x,vector<int> &Violated,double eps=MY_EPS);
+  // Statistics: Generated (new cuts), Duplicates (rejected by Add),
+  // FromPool (found by FindViolated) and Time (seconds between
+  // StartCallback and EndCallback), of the last callback and in total.
+  struct Statistics { long long Callbacks,Generated,Duplicates,FromPool; double Time; };
+  Statistics Last,Total;
+  void StartCallback();
+  void EndCallback();
+  void PrintStatistics(string name) const;
+private:
+  bool directed;
+  int NodeRef;              // id of a node, S is stored as the side without it (ListGraph)
+  vector<int> Tail,Head;    // end nodes of each edge (arc) id, -1 for unused ids
+  vector<int> NodeIds;      // ids of the nodes of the graph
+  vector<char> InS;         // mark of the nodes of the cut being added
+  vector<int> NodeStart,CutNodes,EdgeStart,CutEdges; // cut i has CutNodes[NodeStart[i]..NodeStart[i+1]-1]
+  vector<double> RhsValue;
+  vector<int> Set;          // sorted node set of the cut being added
+  unordered_multimap<unsigned long long,int> Hash2Cut;
+  double StartTime;
+};
+
+// Read a geometric graph, given by a line <number_of_nodes> -1 and a line
+// <node_name> <x> <y> for each node, without generating its edges.
+bool ReadEuclideanGraph(string filename,EuclideanGraph &eg);
+
+// Generate n random points in [0,SizeX) x [0,SizeY), named 1..n.
+bool GenerateRandomEuclideanGraph(EuclideanGraph &eg,
+				  int n, // number of nodes
+				  double SizeX, // coordinate x is a random number in [0,SizeX)
+				  double SizeY); // coordinate y is a random number in [0,SizeY)
+
 //Generate a random complete euclidean ListGraph
 bool GenerateRandomEuclideanListGraph(ListGraph &g,
 		  NodeStringMap &vname, // node names
@@ -238,12 +526,40 @@ bool GenerateRandomEuclideanListDigraph(ListDigraph &g,
 // Obtain a mininum cut for directed graphs from s to t.
 // The returned cut is given by the vector of nodes 'cut' (boolean
 // vector: nodes v in the same side of s have cut[v]=true, otherwise cut[v]=false.
+// To obtain many cuts in the same digraph, use DiMinCutSolver below.
 double DiMinCut(ListDigraph &g,
 		ArcValueMap &weight,
 		DNode &s,
 		DNode &t,
 		DCutMap &cut);
 
+// Minimum cut solver tied to one digraph and one capacity map. The maps of the
+// max-flow (Preflow) are allocated in the first call and reused for all the
+// following source/sink pairs, so a loop of calls does not allocate memory.
+// The capacities can be changed between calls (directly in the capacity
+// map). With warmstart, the max-flow starts from the flow of the previous
+// call, which is used only if it is still a valid preflow for the new
+// capacities and source (e.g., after capacities are only increased);
+// otherwise it starts from zero.
+// Run computes only a minimum cut (the flow of Flow is a maximum preflow);
+// MaxFlow also computes a maximum flow. Both return the value of the cut.
+class DiMinCutSolver {
+public:
+  DiMinCutSolver(ListDigraph &g,ArcValueMap &capacity);
+  // cut[v]=true for the nodes in the side of s
+  double Run(DNode s,DNode t,DCutMap &cut,bool warmstart=false);
+  double MaxFlow(DNode s,DNode t,bool warmstart=false);
+  double Flow(Arc a) const { return(flow[a]); }
+  bool SourceSide(DNode v) const { return(pf.minCut(v)); } // side of v in the minimum cut
+private:
+  ListDigraph &g;
+  ArcValueMap &capacity;
+  ArcValueMap flow;
+  Preflow<ListDigraph, ArcValueMap> pf;
+  bool hasflow;
+  void Init(DNode s,DNode t,bool warmstart);
+};
+
 // Given a graph G=(V,E) and a vector x:E-->[0,1], this routine shows a graph using
 // parameters for color of nodes and color of edges e in E with:
 // 1) x[e]==1